@@ -9,6 +9,7 @@
 #include "icctransform.h"
 #include "mac.h"
 #include "picker.h"
+#include "sampler.h"
 
 #include <QAction>
 #include <QActionGroup>
@@ -19,6 +20,10 @@
 #include <QDesktopServices>
 #include <QDir>
 #include <QFileInfo>
+#include <QFuture>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QMenu>
 #include <QMimeData>
 #include <QMouseEvent>
@@ -34,6 +39,7 @@
 #include <QWindow>
 
 // stdc++
+#include <algorithm>
 #include <random>
 
 // opencv
@@ -58,6 +64,7 @@ public:
     ColorpickerPrivate();
     void init();
     void stylesheet();
+    void transformStatistics();
     void update();
     void view();
     void widget();
@@ -67,6 +74,7 @@ public:
     void activate();
     void deactivate();
     void dropEvent(QDropEvent* event);
+    void dropImage(const QImage& image, const QString& iccCurrentProfile);
     bool eventFilter(QObject* object, QEvent* event);
     bool blocked();
     void loadSettings();
@@ -100,6 +108,10 @@ public Q_SLOTS:
     void magnify3x();
     void magnify4x();
     void magnify5x();
+    void apertureBox();
+    void apertureCircle();
+    void apertureGaussian();
+    void toggleLinearLight(bool checked);
     void capture1();
     void capture2();
     void capture4();
@@ -109,6 +121,7 @@ public Q_SLOTS:
     void capture64();
     void toggleMouseLocation();
     void iccConvertProfileChanged(int index);
+    void prewarm();
     void toggleColors();
     void toggleRGB();
     void toggleR();
@@ -175,6 +188,8 @@ public:
         QPoint origin;
         int displayNumber;
         QString iccProfile;
+        QString imageProfile;  // profile of the image pixels, converted to iccProfile when drawn
+        Sampler::Statistics statistics;  // aperture statistics in iccProfile
     };
     class Edit {
     public:
@@ -191,6 +206,7 @@ public:
     QRect grabRect(QPoint cursor);
     QImage grabBuffer(QRect rect);
     Palette grabPalette(QImage image);
+    void printPdf(const QImage& wheel, const QList<State>& exported, const QList<QImage>& images);
     bool underMouse(QWidget* widget);
     float channelRgb(QColor color, RgbChannel channel);
     float channelHsv(QColor color, HsvChannel channel);
@@ -198,6 +214,7 @@ public:
     QString formatRgb(QColor color, RgbChannel channel);
     QString formatHsv(QColor color, HsvChannel channel);
     QString formatHsl(QColor color, HslChannel channel);
+    QString formatStatistics(const Sampler::Statistics& statistics, RgbChannel channel);
     QString asFloat(float channel);
     QString asHex(int channel);
     QString asPercentage(float channel);
@@ -217,6 +234,7 @@ public:
     QPoint cursor;
     bool active;
     bool mouselocation;
+    bool linearlight;
     Format format;
     Display display;
     Mode mode;
@@ -224,10 +242,15 @@ public:
     Edit edit;
     int opencvk;
     int opencvcolors;
+    Sampler sampler;
     qsizetype selected;
     QRect dragrect;
+    QFuture<QImage> dragimage;
+    QFuture<void> dragmapped;
     QSize size;
     QList<State> states;
+    QImage viewimage;
+    QImage apertureimage;
     QPointer<Colorpicker> window;
     QList<QColor> dragcolors;
     QList<QPoint> dragpositions;
@@ -246,6 +269,7 @@ ColorpickerPrivate::ColorpickerPrivate()
     , magnify(1)
     , active(true)
     , mouselocation(true)
+    , linearlight(false)
     , format(Format::Int8bit)
     , display(Display::Hsv)
     , mode(Mode::None)
@@ -265,6 +289,8 @@ ColorpickerPrivate::init()
     QSurfaceFormat::setDefaultFormat(format);
     // icc profile
     ICCTransform* transform = ICCTransform::instance();
+    transform->setLinkCacheDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                                     + "/icctransforms");
     QDir resources(QApplication::applicationDirPath() + "/../Resources");
     QString inputProfile = resources.filePath("sRGB2014.icc");  // built-in Qt input profile
     transform->setInputProfile(inputProfile);
@@ -302,6 +328,7 @@ ColorpickerPrivate::init()
         iccProfile.clear();
         ui->iccColorProfile->setCurrentIndex(0);
     }
+    prewarm();
     // actions
     ui->toggleActive->setDefaultAction(ui->active);
     ui->togglePin->setDefaultAction(ui->pin);
@@ -320,6 +347,7 @@ ColorpickerPrivate::init()
     connect(ui->toggleColors, &QPushButton::pressed, this, &ColorpickerPrivate::toggleColors);
     connect(ui->iccColorProfile, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this,
             &ColorpickerPrivate::iccConvertProfileChanged);
+    connect(transform, &ICCTransform::outputProfileChanged, this, &ColorpickerPrivate::prewarm);
     connect(ui->r, &Label::triggered, this, &ColorpickerPrivate::toggleR);
     connect(ui->g, &Label::triggered, this, &ColorpickerPrivate::toggleG);
     connect(ui->b, &Label::triggered, this, &ColorpickerPrivate::toggleB);
@@ -377,6 +405,16 @@ ColorpickerPrivate::init()
         for (QAction* action : ui->magnify->actions())
             actions->addAction(action);
     }
+    connect(ui->apertureBox, &QAction::triggered, this, &ColorpickerPrivate::apertureBox);
+    connect(ui->apertureCircle, &QAction::triggered, this, &ColorpickerPrivate::apertureCircle);
+    connect(ui->apertureGaussian, &QAction::triggered, this, &ColorpickerPrivate::apertureGaussian);
+    {
+        QActionGroup* actions = new QActionGroup(this);
+        actions->setExclusive(true);
+        for (QAction* action : ui->apertureKernel->actions())
+            actions->addAction(action);
+    }
+    connect(ui->linearLight, &QAction::toggled, this, &ColorpickerPrivate::toggleLinearLight);
     connect(ui->capture1, &QAction::triggered, this, &ColorpickerPrivate::capture1);
     connect(ui->capture2, &QAction::triggered, this, &ColorpickerPrivate::capture2);
     connect(ui->capture4, &QAction::triggered, this, &ColorpickerPrivate::capture4);
@@ -430,9 +468,53 @@ ColorpickerPrivate::init()
         menu->addAction(action);
         connect(action, &QAction::triggered, [&]() { this->stylesheet(); });
     }
+    {
+        QAction* action = new QAction("Dump transform statistics...", this);
+        action->setShortcut(QKeySequence(Qt::CTRL | Qt::ALT | Qt::Key_T));
+        menu->addAction(action);
+        connect(action, &QAction::triggered, [&]() { this->transformStatistics(); });
+    }
 #endif
 }
 
+void
+ColorpickerPrivate::transformStatistics()
+{
+    // hot profile pairs first, written as json to a temporary file and opened
+    ICCTransform* transform = ICCTransform::instance();
+    QList<ICCTransform::PairStatistics> statistics = transform->pairStatistics();
+    std::sort(statistics.begin(), statistics.end(),
+              [](const ICCTransform::PairStatistics& a, const ICCTransform::PairStatistics& b) {
+                  return a.mapTime > b.mapTime;
+              });
+    QJsonArray pairs;
+    for (const ICCTransform::PairStatistics& pair : statistics) {
+        pairs.append(QJsonObject { { "input", pair.inputProfile },
+                                   { "via", QJsonArray::fromStringList(pair.via) },
+                                   { "output", pair.outputProfile },
+                                   { "builds", static_cast<qint64>(pair.builds) },
+                                   { "buildMs", pair.buildTime / 1e6 },
+                                   { "hits", static_cast<qint64>(pair.hits) },
+                                   { "pixels", static_cast<qint64>(pair.pixels) },
+                                   { "mapMs", pair.mapTime / 1e6 } });
+    }
+    ICCTransform::CacheStatistics cache = transform->cacheStatistics();
+    QJsonObject json { { "cache", QJsonObject { { "count", cache.count },
+                                                { "hits", static_cast<qint64>(cache.hits) },
+                                                { "misses", static_cast<qint64>(cache.misses) },
+                                                { "evictions", static_cast<qint64>(cache.evictions) },
+                                                { "colorHits", static_cast<qint64>(cache.colorHits) },
+                                                { "colorMisses", static_cast<qint64>(cache.colorMisses) } } },
+                       { "pairs", pairs } };
+    QFile file(QDir(QStandardPaths::writableLocation(QStandardPaths::TempLocation))
+                   .filePath("colorpicker-transforms.json"));
+    if (file.open(QFile::WriteOnly | QFile::Truncate)) {
+        file.write(QJsonDocument(json).toJson());
+        file.close();
+        QDesktopServices::openUrl(QUrl::fromLocalFile(file.fileName()));
+    }
+}
+
 void
 ColorpickerPrivate::stylesheet()
 {
@@ -629,38 +711,37 @@ ColorpickerPrivate::update()
     QRect grab = grabRect(cursor);
     QImage buffer = grabBuffer(grab);
     QScreen* screen = QGuiApplication::screenAt(cursor);
-    qreal dpr = buffer.devicePixelRatio();
 
     // paint with device pixel ratio and apply
     // transforms and fill in user space
-    QColor color;
-    QRect rect((grab.width() - aperture) / 2, (grab.height() - aperture) / 2, aperture, aperture);
-    int colorR = 0, colorG = 0, colorB = 0;
-    for (int cx = rect.left(); cx <= rect.right(); cx++) {
-        for (int cy = rect.top(); cy <= rect.bottom(); cy++) {
-            QColor pixel = buffer.pixel(cx * dpr, cy * dpr);
-            colorR += pixel.red();
-            colorG += pixel.green();
-            colorB += pixel.blue();
-        }
-    }
-    int size = rect.width() * rect.height();
-    color = QColor(colorR / size, colorG / size, colorB / size);
+    QRect rect = Sampler::aperture(grab.size(), aperture);
     // icc profile
-    ICCTransform* transform = ICCTransform::instance();
     QString iccCurrentProfile = iccProfile;
     if (!iccCurrentProfile.length()) {
         iccCurrentProfile = iccCursorProfile;
     }
+    // the pixels under the aperture are mapped to the convert profile before sampling,
+    // per channel statistics of mapped colors are not the mapped statistics, the buffer
+    // is reused across frames and placed in the grab by its offset
+    ICCTransform* transform = ICCTransform::instance();
+    bool mapped = false;
     if (iccCurrentProfile != iccCursorProfile) {
-        color = transform->map(color.rgb(), iccCursorProfile, iccCurrentProfile);
-        buffer = transform->map(buffer, iccCursorProfile, iccCurrentProfile);
+        QRect pixels = Sampler::pixels(rect, buffer.devicePixelRatio()).intersected(buffer.rect());
+        if (transform->mapInto(buffer, pixels, apertureimage, { iccCursorProfile, iccCurrentProfile })) {
+            apertureimage.setOffset(pixels.topLeft());
+            mapped = true;
+        }
     }
-    // state
+    const QImage& sampled = mapped ? apertureimage : buffer;
+    // linear light decodes through the cached tone curves of the convert profile
+    sampler.setLinearTable(linearlight ? transform->linearTable(iccCurrentProfile, Sampler::depth(sampled.format()))
+                                       : QList<float>());
+    QColor color = sampler.average(sampled, rect);
+    Sampler::Statistics statistics = sampler.statistics(sampled, rect);
+    // state, the buffer stays in the cursor profile and is converted when drawn
     {
-        state = State {
-            color, rect, magnify, buffer, cursor, screen->geometry().topLeft(), displayNumber, iccCurrentProfile
-        };
+        state = State { color, rect, magnify, buffer, cursor, screen->geometry().topLeft(), displayNumber,
+                        iccCurrentProfile, iccCursorProfile, statistics };
     }
     view();
     widget();
@@ -677,12 +758,18 @@ ColorpickerPrivate::view()
     ICCTransform* transform = ICCTransform::instance();
     if (state.iccProfile != transform->outputProfile()) {
         color = transform->map(state.color.rgb(), state.iccProfile, transform->outputProfile());
-        image = transform->map(state.image, state.iccProfile, transform->outputProfile());
     }
     else {
         color = state.color;
-        image = state.image;
     }
+    // one pass through the convert profile to the display, limited to the pixels
+    // inside the magnified view, reused across frames and only reallocated when
+    // the visible size changes
+    QRect visible = QRectF(0, 0, width * dpr / state.magnify, height * dpr / state.magnify).toAlignedRect();
+    image = transform->mapInto(state.image, visible, viewimage,
+                               { state.imageProfile, state.iccProfile, transform->outputProfile() })
+                ? viewimage
+                : state.image;
 
     // pixmap
     QPixmap pixmap(width * dpr, height * dpr);
@@ -736,6 +823,9 @@ ColorpickerPrivate::widget()
         ui->r->setText(QString("%1").arg(formatRgb(state.color, RgbChannel::R)));
         ui->g->setText(QString("%1").arg(formatRgb(state.color, RgbChannel::G)));
         ui->b->setText(QString("%1").arg(formatRgb(state.color, RgbChannel::B)));
+        ui->r->setToolTip(formatStatistics(state.statistics, RgbChannel::R));
+        ui->g->setToolTip(formatStatistics(state.statistics, RgbChannel::G));
+        ui->b->setToolTip(formatStatistics(state.statistics, RgbChannel::B));
     }
     // hsv
     {
@@ -835,6 +925,31 @@ ColorpickerPrivate::profile()
     transform->setOutputProfile(outputProfile);
 }
 
+void
+ColorpickerPrivate::prewarm()
+{
+    // the aperture map in update, the composed view and the color fill in view, for
+    // the cursor profile and each convert profile, the current convert profile first,
+    // grabs are premultiplied
+    ICCTransform* transform = ICCTransform::instance();
+    QString cursorProfile = iccCursorProfile.length() ? iccCursorProfile : transform->inputProfile();
+    QStringList profiles = { iccProfile.length() ? iccProfile : cursorProfile };
+    for (int i = 0; i < ui->iccColorProfile->count(); ++i) {
+        QString profile = ui->iccColorProfile->itemData(i, Qt::UserRole).toString();
+        if (profile.length() && !profiles.contains(profile)) {
+            profiles.append(profile);
+        }
+    }
+    QList<ICCTransform::Prewarm> transforms;
+    for (const QString& profile : profiles) {
+        transforms.append({ { cursorProfile, profile }, QImage::Format_ARGB32_Premultiplied });
+        transforms.append({ { cursorProfile, profile, transform->outputProfile() },
+                            QImage::Format_ARGB32_Premultiplied });
+        transforms.append({ { profile, transform->outputProfile() }, QImage::Format_RGB32 });
+    }
+    transform->prewarm(transforms);
+}
+
 void
 ColorpickerPrivate::blank()
 {
@@ -855,7 +970,9 @@ ColorpickerPrivate::blank()
         iccCurrentProfile = iccCursorProfile;
     }
     // state
-    state = State { color, QRect(), magnify, image, QPoint(), QPoint(), displayNumber, iccCurrentProfile };
+    state = State {
+        color, QRect(), magnify, image, QPoint(), QPoint(), displayNumber, iccCurrentProfile, iccCurrentProfile
+    };
 
     ui->view->setPixmap(QPixmap::fromImage(image));
     // rgb
@@ -898,9 +1015,12 @@ ColorpickerPrivate::dropEvent(QDropEvent* event)
                 QString filePath = url.toLocalFile();
                 QImage image(filePath);
                 if (!image.isNull()) {
-                    if (image.format() != QImage::Format_ARGB32_Premultiplied) {
-                        image = image.convertToFormat(
-                            QImage::Format_ARGB32_Premultiplied);  // works better with QPixmap draw_iamge
+                    // rgb formats lcms has a layout for are mapped as loaded, alpha included,
+                    // indexed, gray and packed formats without one are expanded first
+                    if (image.pixelFormat().colorModel() != QPixelFormat::RGB
+                        || !ICCTransform::instance()->isMappable(image.format())) {
+                        image = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32
+                                                                              : QImage::Format_RGB32);
                     }
                     images.append(image);
                 }
@@ -916,39 +1036,56 @@ ColorpickerPrivate::dropEvent(QDropEvent* event)
     if (!iccCurrentProfile.length()) {
         iccCurrentProfile = iccCursorProfile;
     }
-    for (QImage image : images) {
+    QString iccCurrentId = transform->profileId(iccCurrentProfile);
+    QList<QFuture<QImage>> mapped;
+    for (const QImage& image : images) {
+        // large images convert on the transform pool, embedded colorspaces are
+        // compared to the profile by content
         QColorSpace colorspace = image.colorSpace();  // embedded colorspace
-        if (colorspace.isValid()) {
-            QString iccColorspaceProfile = colorspace.description();
-            if (iccCurrentProfile != iccColorspaceProfile) {
-                image = transform->map(image, colorspace, iccCurrentProfile);
-            }
+        if (colorspace.isValid() && transform->profileId(colorspace) != iccCurrentId) {
+            mapped.append(transform->mapAsync(image, colorspace, iccCurrentProfile));
+        }
+        else if (!colorspace.isValid() && iccCurrentProfile != iccCursorProfile) {
+            mapped.append(transform->mapAsync(image, iccCursorProfile, iccCurrentProfile));
         }
         else {
-            if (iccCurrentProfile != iccCursorProfile) {
-                image = transform->map(image, iccCursorProfile, iccCurrentProfile);
-            }
+            mapped.append(QtFuture::makeReadyValueFuture(image));
         }
-        Palette palette = grabPalette(image);
-        if (palette.colors.size()) {
-            for (int i = 0; i < palette.colors.size(); ++i) {
-                QPoint pos = palette.positions.at(i);
-                QRect grab = grabRect(pos);
-                QImage buffer = image.copy(grab);
-                // paint with device pixel ratio and apply
-                // transforms and fill in user space
-                QColor color = palette.colors.at(i);
-                QRect rect((grab.width() - aperture) / 2, (grab.height() - aperture) / 2, aperture, aperture);
-                // state
-                State drag = State { color, rect, magnify, buffer, pos, QPoint(0, 0), displayNumber, iccCurrentProfile };
-                states.push_back(drag);
+    }
+    // states are added back on this thread in drop order once every conversion is done
+    QtFuture::whenAll(mapped.begin(), mapped.end())
+        .then(this, [this, iccCurrentProfile](const QList<QFuture<QImage>>& images) {
+            for (const QFuture<QImage>& image : images) {
+                if (image.resultCount()) {
+                    dropImage(image.result(), iccCurrentProfile);
+                }
             }
-            selected = states.count() - 1;
-            view();
-            widget();
+        });
+    deactivate();
+}
+
+void
+ColorpickerPrivate::dropImage(const QImage& image, const QString& iccCurrentProfile)
+{
+    Palette palette = grabPalette(image);
+    if (palette.colors.size()) {
+        for (int i = 0; i < palette.colors.size(); ++i) {
+            QPoint pos = palette.positions.at(i);
+            QRect grab = grabRect(pos);
+            QImage buffer = image.copy(grab);
+            // paint with device pixel ratio and apply
+            // transforms and fill in user space
+            QColor color = palette.colors.at(i);
+            QRect rect = Sampler::aperture(grab.size(), aperture);
+            // state
+            State drag = State { color, rect, magnify, buffer, pos, QPoint(0, 0), displayNumber,
+                                 iccCurrentProfile, iccCurrentProfile };
+            states.push_back(drag);
         }
+        selected = states.count() - 1;
+        view();
+        widget();
     }
-    deactivate();
 }
 
 bool
@@ -1051,6 +1188,13 @@ ColorpickerPrivate::loadSettings()
     iccProfile = settings.value("iccProfile", "").toString();
     aperture = settings.value("aperture", aperture).toInt();
     ui->aperture->setValue(aperture);
+    int kernel = settings.value("apertureKernel", sampler.kernel()).toInt();
+    sampler.setKernel(static_cast<Sampler::Kernel>(qBound<int>(Sampler::Box, kernel, Sampler::Gaussian)));
+    ui->apertureBox->setChecked(sampler.kernel() == Sampler::Box);
+    ui->apertureCircle->setChecked(sampler.kernel() == Sampler::Circle);
+    ui->apertureGaussian->setChecked(sampler.kernel() == Sampler::Gaussian);
+    linearlight = settings.value("linearLight", linearlight).toBool();
+    ui->linearLight->setChecked(linearlight);
     ui->markerSize->setValue(settings.value("markerSize", ui->markerSize->value()).toInt());
     ui->colorWheel->setMarkerSize((qreal)ui->markerSize->value() / ui->markerSize->maximum());
     ui->backgroundOpacity->setValue(settings.value("backgroundOpacity", ui->backgroundOpacity->value()).toInt());
@@ -1073,6 +1217,8 @@ ColorpickerPrivate::saveSettings()
     QSettings settings(MACOSX_BUNDLE_GUI_IDENTIFIER, MACOSX_BUNDLE_BUNDLE_NAME);
     settings.setValue("iccProfile", iccProfile);
     settings.setValue("aperture", aperture);
+    settings.setValue("apertureKernel", sampler.kernel());
+    settings.setValue("linearLight", linearlight);
     settings.setValue("markerSize", ui->markerSize->value());
     settings.setValue("backgroundOpacity", ui->backgroundOpacity->value());
     settings.setValue("iqLine", ui->iqline->isChecked());
@@ -1160,13 +1306,21 @@ ColorpickerPrivate::drag()
     if (!iccCurrentProfile.length()) {
         iccCurrentProfile = iccCursorProfile;
     }
+    // the drag rectangle converts on the transform pool and its palette is taken on
+    // this thread once done, a new drag supersedes one still converting
+    dragimage.cancel();
     if (iccCurrentProfile != iccCursorProfile) {
-        image = transform->map(image, iccCursorProfile, iccCurrentProfile);
+        dragimage = transform->mapAsync(image, iccCursorProfile, iccCurrentProfile);
     }
-    Palette palette = grabPalette(image);
-    dragcolors = palette.colors;
-    dragpositions = palette.positions;
-    update();
+    else {
+        dragimage = QtFuture::makeReadyValueFuture(image);
+    }
+    dragmapped = dragimage.then(this, [this](const QImage& image) {
+        Palette palette = grabPalette(image);
+        dragcolors = palette.colors;
+        dragpositions = palette.positions;
+        update();
+    });
 }
 
 void
@@ -1179,6 +1333,11 @@ ColorpickerPrivate::pickClosed()
 void
 ColorpickerPrivate::dragClosed()
 {
+    // colors of a drag still converting are added once it is done
+    if (!dragmapped.isFinished()) {
+        dragmapped.then(this, [this] { dragClosed(); });
+        return;
+    }
     if (dragcolors.size()) {
         for (int i = 0; i < dragcolors.size(); ++i) {
             QPoint pos = dragrect.topLeft() + dragpositions.at(i);
@@ -1189,21 +1348,16 @@ ColorpickerPrivate::dragClosed()
             // paint with device pixel ratio and apply
             // transforms and fill in user space
             QColor color = dragcolors.at(i);
-            QRect rect((grab.width() - aperture) / 2, (grab.height() - aperture) / 2, aperture, aperture);
+            QRect rect = Sampler::aperture(grab.size(), aperture);
             // icc profile
             // colors are already using correct profile
-            ICCTransform* transform = ICCTransform::instance();
             QString iccCurrentProfile = iccProfile;
             if (!iccCurrentProfile.length()) {
                 iccCurrentProfile = iccCursorProfile;
             }
-            if (iccCurrentProfile != iccCursorProfile) {
-                buffer = transform->map(buffer, iccCursorProfile, iccCurrentProfile);
-            }
-            // state
-            State drag = State {
-                color, rect, magnify, buffer, pos, screen->geometry().topLeft(), displayNumber, iccCurrentProfile
-            };
+            // state, the buffer stays in the cursor profile and is converted when drawn
+            State drag = State { color, rect, magnify, buffer, pos, screen->geometry().topLeft(), displayNumber,
+                                 iccCurrentProfile, iccCursorProfile };
             states.push_back(drag);
         }
         dragcolors.clear();
@@ -1392,6 +1546,34 @@ ColorpickerPrivate::magnify5x()
     update();
 }
 
+void
+ColorpickerPrivate::apertureBox()
+{
+    sampler.setKernel(Sampler::Box);
+    update();
+}
+
+void
+ColorpickerPrivate::apertureCircle()
+{
+    sampler.setKernel(Sampler::Circle);
+    update();
+}
+
+void
+ColorpickerPrivate::apertureGaussian()
+{
+    sampler.setKernel(Sampler::Gaussian);
+    update();
+}
+
+void
+ColorpickerPrivate::toggleLinearLight(bool checked)
+{
+    linearlight = checked;
+    update();
+}
+
 void
 ColorpickerPrivate::capture1()
 {
@@ -1707,6 +1889,33 @@ ColorpickerPrivate::clear()
 
 void
 ColorpickerPrivate::pdf()
+{
+    // the colorwheel render and the state images convert on the transform pool,
+    // the document is printed on this thread once every conversion is done
+    ICCTransform* transform = ICCTransform::instance();
+    QPixmap widget(ui->colorWheel->size() * ui->colorWheel->devicePixelRatio());
+    widget.setDevicePixelRatio(ui->colorWheel->devicePixelRatio());
+    widget.fill(window->palette().base().color());  // fill with palette before transform
+    ui->colorWheel->render(&widget);
+    QImage wheel = widget.toImage();
+    QList<QFuture<QImage>> mapped;
+    mapped.append(transform->mapAsync(wheel, transform->outputProfile(), transform->inputProfile()));
+    for (const State& state : states) {
+        mapped.append(
+            transform->mapAsync(state.image, { state.imageProfile, state.iccProfile, transform->inputProfile() }));
+    }
+    QtFuture::whenAll(mapped.begin(), mapped.end())
+        .then(this, [this, wheel, exported = states](const QList<QFuture<QImage>>& futures) {
+            QList<QImage> images;
+            for (qsizetype i = 1; i < futures.count(); ++i) {
+                images.append(futures[i].resultCount() ? futures[i].result() : exported[i - 1].image);
+            }
+            printPdf(futures[0].resultCount() ? futures[0].result() : wheel, exported, images);
+        });
+}
+
+void
+ColorpickerPrivate::printPdf(const QImage& wheel, const QList<State>& exported, const QList<QImage>& images)
 {
     QDateTime datetime = QDateTime::currentDateTime();
     QString datestamp = QString("%2 at %3").arg(datetime.toString("yyyy-MM-dd")).arg(datetime.toString("hh:mm:ss"));
@@ -1725,8 +1934,10 @@ ColorpickerPrivate::pdf()
     ICCTransform* transform = ICCTransform::instance();
     QBrush palettetext = window->palette().text();
     QBrush palettebase = window->palette().base();
-    QRgb text = transform->map(palettetext.color().rgb(), transform->outputProfile(), transform->inputProfile());
-    QRgb base = transform->map(palettebase.color().rgb(), transform->outputProfile(), transform->inputProfile());
+    QList<QRgb> palette = transform->map(QList<QRgb> { palettetext.color().rgb(), palettebase.color().rgb() },
+                                         transform->outputProfile(), transform->inputProfile());
+    QRgb text = palette[0];
+    QRgb base = palette[1];
     QTextCharFormat headerformat;
     headerformat.setForeground(QBrush(QColor::fromRgb(text)));
     headerformat.setBackground(QBrush(QColor::fromRgb(base)));
@@ -1764,12 +1975,8 @@ ColorpickerPrivate::pdf()
             QTextTableCell cell = table->cellAt(0, 0);
             QTextCursor cellcursor = cell.firstCursorPosition();
             cell.setFormat(headerformat);
-            QPixmap widget(ui->colorWheel->size() * ui->colorWheel->devicePixelRatio());
-            widget.setDevicePixelRatio(ui->colorWheel->devicePixelRatio());
-            widget.fill(palettebase.color());  // fill with palette before transform
-            ui->colorWheel->render(&widget);
             QString format = "png";
-            QImage image = transform->map(widget.toImage(), transform->outputProfile(), transform->inputProfile());
+            QImage image = wheel;
             image.setColorSpace(QColorSpace::SRgb);
             QTextImageFormat imageformat;
             imageformat.setWidth(ui->colorWheel->width() / 2);
@@ -1786,7 +1993,7 @@ ColorpickerPrivate::pdf()
     cursor.insertHtml("<br>");
     // table
     {
-        QTextTable* table = cursor.insertTable(static_cast<int>(states.count()) + 1, 5);
+        QTextTable* table = cursor.insertTable(static_cast<int>(exported.count()) + 1, 5);
         // format
         {
             qreal padding = 5;
@@ -1842,14 +2049,23 @@ ColorpickerPrivate::pdf()
             cell.setFormat(headerformat);
             cellcursor.insertHtml("<h5 style='color:rgb(255, 255, 255)'>Display</h5>");
         }
+        // state colors, mapped in one batch
+        QList<QRgb> colors;
+        {
+            QStringList profiles;
+            for (const State& state : exported) {
+                colors.append(state.color.rgb());
+                profiles.append(state.iccProfile);
+            }
+            colors = transform->map(colors, profiles, transform->inputProfile());
+        }
         // states
-        for (int i = 0; i < states.count(); i++) {
-            State state = states[i];
+        for (int i = 0; i < exported.count(); i++) {
+            State state = exported[i];
 
-            // icc profile
-            ICCTransform* transform = ICCTransform::instance();
-            QColor color = transform->map(state.color.rgb(), state.iccProfile, transform->inputProfile());
-            QImage image = transform->map(state.image, state.iccProfile, transform->inputProfile());
+            // icc profile, the image was converted by pdf()
+            QColor color = QColor::fromRgb(colors[i]);
+            QImage image = images[i];
             qreal dpr = state.image.devicePixelRatio();
 
             // index
@@ -1935,6 +2151,25 @@ ColorpickerPrivate::pdf()
                 cellcursor.insertHtml(QString("<small><b>Color profile:</b> %1%2</small>")
                                           .arg(QFileInfo(state.iccProfile).fileName())
                                           .arg("<br>"));
+                // aperture statistics
+                const Sampler::Statistics& statistics = state.statistics;
+                if (statistics.median.isValid()) {
+                    QList<QPair<QString, QColor>> rows = { { "Median", statistics.median },
+                                                           { "5th percentile", statistics.low },
+                                                           { "95th percentile", statistics.high },
+                                                           { "Minimum", statistics.minimum },
+                                                           { "Maximum", statistics.maximum },
+                                                           { "Trimmed mean", statistics.trimmed },
+                                                           { "Deviation", statistics.deviation } };
+                    for (const QPair<QString, QColor>& row : rows) {
+                        cellcursor.insertHtml(QString("<small><b>%1:</b> %2, %3, %4%5</small>")
+                                                  .arg(row.first)
+                                                  .arg(formatRgb(row.second, RgbChannel::R))
+                                                  .arg(formatRgb(row.second, RgbChannel::G))
+                                                  .arg(formatRgb(row.second, RgbChannel::B))
+                                                  .arg("<br>"));
+                    }
+                }
             }
         }
     }
@@ -2067,6 +2302,23 @@ ColorpickerPrivate::formatHsl(QColor hsl, HslChannel channel)
     }
 }
 
+QString
+ColorpickerPrivate::formatStatistics(const Sampler::Statistics& statistics, RgbChannel channel)
+{
+    if (!statistics.median.isValid()) {
+        return QString();
+    }
+    return QString("Median: %1\n5th percentile: %2\n95th percentile: %3\nMinimum: %4\nMaximum: %5\n"
+                   "Trimmed mean: %6\nDeviation: %7")
+        .arg(formatRgb(statistics.median, channel))
+        .arg(formatRgb(statistics.low, channel))
+        .arg(formatRgb(statistics.high, channel))
+        .arg(formatRgb(statistics.minimum, channel))
+        .arg(formatRgb(statistics.maximum, channel))
+        .arg(formatRgb(statistics.trimmed, channel))
+        .arg(formatRgb(statistics.deviation, channel));
+}
+
 QString
 ColorpickerPrivate::asFloat(float channel)
 {
@@ -2174,7 +2426,10 @@ Colorpicker::pickEvent(PickEvent event)
 {
     if (!p->blocked()) {
         p->displayNumber = event.displayNumber;
-        p->iccCursorProfile = event.iccProfile;
+        if (p->iccCursorProfile != event.iccProfile) {
+            p->iccCursorProfile = event.iccProfile;
+            p->prewarm();
+        }
         p->cursor = event.cursor;
         p->update();
     }
@@ -265,10 +265,22 @@ ColorwheelPrivate::rebuild()
         p.restore();
     }
 
-    for (const QPair<QColor, QPair<QString, QString>>& pair : colors) {
+    // marker colors are mapped to the display in one batch
+    QList<QRgb> markers;
+    {
+        QStringList filenames;
+        for (const QPair<QColor, QPair<QString, QString>>& pair : colors) {
+            markers.append(pair.first.rgb());
+            filenames.append(pair.second.second);
+        }
+        ICCTransform* transform = ICCTransform::instance();
+        markers = transform->map(markers, filenames, transform->outputProfile());
+    }
+
+    for (qsizetype i = 0; i < colors.count(); ++i) {
+        const QPair<QColor, QPair<QString, QString>>& pair = colors[i];
         QColor color = pair.first;
         QString label = pair.second.first;
-        QString filename = pair.second.second;
         p.save();
         p.setPen(QPen(brush, 2.0));
         p.rotate((1 - color.hueF()) * 360);
@@ -283,13 +295,7 @@ ColorwheelPrivate::rebuild()
         }
 
         {
-            QColor mapped = color;
-            ICCTransform* transform = ICCTransform::instance();
-            if (filename != transform->outputProfile()) {
-                mapped = transform->map(mapped.rgb(), filename, transform->outputProfile());
-            }
-
-            p.setBrush(QBrush(mapped));
+            p.setBrush(QBrush(QColor::fromRgb(markers[i])));
             p.setPen(QPen(brush, stroke));
 
             QRectF rect(-ellipse / 2 + length, -ellipse / 2, ellipse, ellipse);
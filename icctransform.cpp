@@ -3,150 +3,1990 @@
 // https://github.com/mikaelsundell/colorman
 
 #include "icctransform.h"
-#include <QApplication>
+#include <QAtomicInteger>
+#include <QCache>
 #include <QColorSpace>
-#include <QMap>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
 #include <QMutex>
 #include <QPointer>
+#include <QPromise>
+#include <QReadWriteLock>
+#include <QSaveFile>
+#include <QScopeGuard>
+#include <QSemaphore>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVarLengthArray>
+
+// stdc++
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#if LCMS_VERSION < 2130
+#    error "lcms 2.13 or later is required for premultiplied formats"
+#endif
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
 
 QScopedPointer<ICCTransform, ICCTransform::Deleter> ICCTransform::pi;
 
+namespace {
+
+// node values are stored in 8-bit scale times 128 and weights sum to 4096,
+// interpolated values are rounded back to 8-bit by shifting 7 + 12 bits
+const int lutValueBits = 7;
+const int lutWeightBits = 12;
+const int lutShift = lutValueBits + lutWeightBits;
+
+class Lut {
+public:
+    Lut(int size)
+        : size(size)
+        , strides { size * size * 4, size * 4, 4 }
+        , table(static_cast<size_t>(size) * size * size * 4, 0)
+        , deltaE(0.0)
+    {
+        for (int v = 0; v < 256; ++v) {
+            // 255 uses the last cell with a full fraction so the opposite
+            // nodes stay inside the table
+            int position = (v * (size - 1) * (1 << lutWeightBits) + 127) / 255;
+            int index = std::min(position >> lutWeightBits, size - 2);
+            fractions[v] = position - (index << lutWeightBits);
+            for (int c = 0; c < 3; ++c) {
+                offsets[c][v] = index * strides[c];
+            }
+        }
+    }
+    int size;
+    int strides[3];
+    int fractions[256];
+    int offsets[3][256];
+    std::vector<quint16> table;  // rgbx nodes, red major
+    double deltaE;
+};
+
+// memoized colors, each entry packs a valid bit, the 24-bit input rgb and the 24-bit
+// output rgb into one atomic so concurrent lookups never see a torn entry
+const int memoBits = 12;
+const int memoSize = 1 << memoBits;
+const int memoProbes = 4;
+const quint64 memoValid = quint64(1) << 48;
+
+class Memo {
+public:
+    bool find(QRgb color, QRgb* mapped) const
+    {
+        quint64 rgb = color & 0xffffff;
+        for (int probe = 0, slot = index(color); probe < memoProbes; ++probe, slot = (slot + 1) & (memoSize - 1)) {
+            quint64 entry = entries[slot].loadRelaxed();
+            if (!entry) {
+                return false;
+            }
+            if (((entry >> 24) & 0xffffff) == rgb) {
+                *mapped = (color & 0xff000000) | static_cast<QRgb>(entry & 0xffffff);
+                return true;
+            }
+        }
+        return false;
+    }
+    void insert(QRgb color, QRgb mapped)
+    {
+        quint64 entry = memoValid | (quint64(color & 0xffffff) << 24) | (mapped & 0xffffff);
+        int slot = index(color);
+        for (int probe = 0; probe < memoProbes; ++probe) {
+            if (entries[(slot + probe) & (memoSize - 1)].testAndSetRelaxed(0, entry)) {
+                return;
+            }
+        }
+        entries[slot].storeRelaxed(entry);  // probes are full, replace the first
+    }
+
+private:
+    static int index(QRgb color) { return static_cast<int>(((color & 0xffffff) * 0x9e3779b1u) >> (32 - memoBits)); }
+    QAtomicInteger<quint64> entries[memoSize];
+};
+
+// rgb profiles lcms maps through their colorants and tone curves, tables take
+// precedence and a2b0 and b2a0 stand in for intents without tables of their own
+bool
+matrixShaper(cmsHPROFILE profile, cmsUInt32Number intent)
+{
+    if (cmsGetColorSpace(profile) != cmsSigRgbData || !cmsIsMatrixShaper(profile)) {
+        return false;
+    }
+    for (cmsUInt32Number tables : { cmsUInt32Number(INTENT_PERCEPTUAL), intent }) {
+        if (cmsIsCLUT(profile, tables, LCMS_USED_AS_INPUT) || cmsIsCLUT(profile, tables, LCMS_USED_AS_OUTPUT)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// matrix-shaper description of an rgb profile, colorants and white point in pcs
+// xyz and tone curves sampled over the unit range, used to detect equivalent profiles
+const int shaperSamples = 64;
+const double shaperTolerance = 0.002;  // about half an 8-bit code value
+
+class Shaper {
+public:
+    Shaper(cmsHPROFILE profile)
+        : valid(matrixShaper(profile, INTENT_PERCEPTUAL))
+    {
+        const cmsTagSignature colorantTags[3] = { cmsSigRedColorantTag, cmsSigGreenColorantTag,
+                                                  cmsSigBlueColorantTag };
+        const cmsTagSignature curveTags[3] = { cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag };
+        for (int c = 0; c < 3 && valid; ++c) {
+            const cmsCIEXYZ* colorant = static_cast<const cmsCIEXYZ*>(cmsReadTag(profile, colorantTags[c]));
+            const cmsToneCurve* curve = static_cast<const cmsToneCurve*>(cmsReadTag(profile, curveTags[c]));
+            if (!colorant || !curve) {
+                valid = false;
+                break;
+            }
+            colorants[c][0] = colorant->X;
+            colorants[c][1] = colorant->Y;
+            colorants[c][2] = colorant->Z;
+            for (int i = 0; i < shaperSamples; ++i) {
+                curves[c][i] = cmsEvalToneCurveFloat(curve, static_cast<cmsFloat32Number>(i) / (shaperSamples - 1));
+            }
+        }
+        const cmsCIEXYZ* media = static_cast<const cmsCIEXYZ*>(cmsReadTag(profile, cmsSigMediaWhitePointTag));
+        const cmsCIEXYZ* d50 = cmsD50_XYZ();
+        white[0] = media ? media->X : d50->X;
+        white[1] = media ? media->Y : d50->Y;
+        white[2] = media ? media->Z : d50->Z;
+    }
+    bool equivalent(const Shaper& other) const
+    {
+        if (!valid || !other.valid) {
+            return false;
+        }
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i < 3; ++i) {
+                if (qAbs(colorants[c][i] - other.colorants[c][i]) > shaperTolerance
+                    || qAbs(white[i] - other.white[i]) > shaperTolerance) {
+                    return false;
+                }
+            }
+            for (int i = 0; i < shaperSamples; ++i) {
+                if (qAbs(curves[c][i] - other.curves[c][i]) > shaperTolerance) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    bool valid;
+    double colorants[3][3];  // red, green and blue xyz
+    double white[3];
+    float curves[3][shaperSamples];
+};
+
+// 16.16 reciprocals of 8-bit alpha, values are unpremultiplied with rounding
+// the same way as qUnpremultiply
+class Unpremultiply {
+public:
+    Unpremultiply()
+    {
+        factors[0] = 0;
+        for (int alpha = 1; alpha < 256; ++alpha) {
+            factors[alpha] = static_cast<quint32>((255 * 0x10000 + alpha / 2) / alpha);
+        }
+    }
+    quint32 factors[256];
+};
+
+const Unpremultiply unpremultiply;
+
+inline int
+unpremultiplied(int value, int alpha)
+{
+    return static_cast<int>(qMin<quint32>((value * unpremultiply.factors[alpha] + 0x8000) >> 16, 255));
+}
+
+inline int
+premultiplied(int value, int alpha)
+{
+    int t = value * alpha + 0x80;
+    return (t + (t >> 8)) >> 8;  // divided by 255 with rounding
+}
+
+inline void
+lutNodes(const Lut& lut, int r, int g, int b, const quint16** nodes, int* weights)
+{
+    int fr = lut.fractions[r];
+    int fg = lut.fractions[g];
+    int fb = lut.fractions[b];
+    int sr = lut.strides[0];
+    int sg = lut.strides[1];
+    int sb = lut.strides[2];
+    // tetrahedral interpolation, walks from the base node to the opposite
+    // corner along the axes in order of decreasing fraction
+    int s1, s2, f1, f2, f3;
+    if (fr >= fg) {
+        if (fg >= fb) {
+            s1 = sr, s2 = sg, f1 = fr, f2 = fg, f3 = fb;
+        }
+        else if (fr >= fb) {
+            s1 = sr, s2 = sb, f1 = fr, f2 = fb, f3 = fg;
+        }
+        else {
+            s1 = sb, s2 = sr, f1 = fb, f2 = fr, f3 = fg;
+        }
+    }
+    else {
+        if (fr >= fb) {
+            s1 = sg, s2 = sr, f1 = fg, f2 = fr, f3 = fb;
+        }
+        else if (fg >= fb) {
+            s1 = sg, s2 = sb, f1 = fg, f2 = fb, f3 = fr;
+        }
+        else {
+            s1 = sb, s2 = sg, f1 = fb, f2 = fg, f3 = fr;
+        }
+    }
+    const quint16* base = lut.table.data() + lut.offsets[0][r] + lut.offsets[1][g] + lut.offsets[2][b];
+    nodes[0] = base;
+    nodes[1] = base + s1;
+    nodes[2] = base + s1 + s2;
+    nodes[3] = base + sr + sg + sb;
+    weights[0] = (1 << lutWeightBits) - f1;
+    weights[1] = f1 - f2;
+    weights[2] = f2 - f3;
+    weights[3] = f3;
+}
+
+// premultiplied pixels are unpremultiplied before the lookup and premultiplied
+// again after it, alpha is carried through
+template<int R, int G, int B, int A, int Bytes, bool P>
+inline void
+lutPixel(const Lut& lut, const uchar* input, const quint16** nodes, int* weights)
+{
+    if (P) {
+        int alpha = input[A];
+        lutNodes(lut, unpremultiplied(input[R], alpha), unpremultiplied(input[G], alpha),
+                 unpremultiplied(input[B], alpha), nodes, weights);
+    }
+    else {
+        lutNodes(lut, input[R], input[G], input[B], nodes, weights);
+    }
+}
+
+template<int R, int G, int B, int A, int Bytes, bool P>
+inline void
+lutStore(const uchar* input, uchar* output, int r, int g, int b)
+{
+    if (A >= 0) {
+        output[A] = input[A];
+    }
+    if (P) {
+        int alpha = input[A];
+        r = premultiplied(r, alpha);
+        g = premultiplied(g, alpha);
+        b = premultiplied(b, alpha);
+    }
+    output[R] = static_cast<uchar>(r);
+    output[G] = static_cast<uchar>(g);
+    output[B] = static_cast<uchar>(b);
+}
+
+template<int R, int G, int B, int A, int Bytes, bool P = false>
+void
+lutScalar(const Lut& lut, const uchar* input, uchar* output, int width)
+{
+    const quint16* nodes[4];
+    int weights[4];
+    for (int x = 0; x < width; ++x, input += Bytes, output += Bytes) {
+        lutPixel<R, G, B, A, Bytes, P>(lut, input, nodes, weights);
+        int values[3];
+        for (int c = 0; c < 3; ++c) {
+            int sum = nodes[0][c] * weights[0] + nodes[1][c] * weights[1] + nodes[2][c] * weights[2]
+                      + nodes[3][c] * weights[3];
+            values[c] = (sum + (1 << (lutShift - 1))) >> lutShift;
+        }
+        lutStore<R, G, B, A, Bytes, P>(input, output, values[0], values[1], values[2]);
+    }
+}
+
+#if defined(__SSE2__)
+inline __m128i
+lutSum(const quint16* const* nodes, const int* weights)
+{
+    __m128i c0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(nodes[0]));
+    __m128i c1 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(nodes[1]));
+    __m128i c2 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(nodes[2]));
+    __m128i c3 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(nodes[3]));
+    // interleaved node pairs, madd multiplies and sums each pair per channel
+    __m128i w01 = _mm_set1_epi32((weights[1] << 16) | weights[0]);
+    __m128i w23 = _mm_set1_epi32((weights[3] << 16) | weights[2]);
+    return _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(c0, c1), w01),
+                         _mm_madd_epi16(_mm_unpacklo_epi16(c2, c3), w23));
+}
+
+template<int R, int G, int B, int A, int Bytes, bool P>
+void
+lutSSE2(const Lut& lut, const uchar* input, uchar* output, int width)
+{
+    const quint16* nodes[4];
+    int weights[4];
+    const __m128i round = _mm_set1_epi32(1 << (lutShift - 1));
+    int x = 0;
+    for (; x + 1 < width; x += 2, input += Bytes * 2, output += Bytes * 2) {
+        lutPixel<R, G, B, A, Bytes, P>(lut, input, nodes, weights);
+        __m128i p0 = _mm_srli_epi32(_mm_add_epi32(lutSum(nodes, weights), round), lutShift);
+        lutPixel<R, G, B, A, Bytes, P>(lut, input + Bytes, nodes, weights);
+        __m128i p1 = _mm_srli_epi32(_mm_add_epi32(lutSum(nodes, weights), round), lutShift);
+        quint32 values[2];
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(values),
+                         _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_setzero_si128()));
+        const uchar* v0 = reinterpret_cast<const uchar*>(&values[0]);
+        const uchar* v1 = reinterpret_cast<const uchar*>(&values[1]);
+        lutStore<R, G, B, A, Bytes, P>(input, output, v0[0], v0[1], v0[2]);
+        lutStore<R, G, B, A, Bytes, P>(input + Bytes, output + Bytes, v1[0], v1[1], v1[2]);
+    }
+    lutScalar<R, G, B, A, Bytes, P>(lut, input, output, width - x);
+}
+#endif
+
+#if defined(__ARM_NEON)
+template<int R, int G, int B, int A, int Bytes, bool P>
+void
+lutNEON(const Lut& lut, const uchar* input, uchar* output, int width)
+{
+    const quint16* nodes[4];
+    int weights[4];
+    const uint32x4_t round = vdupq_n_u32(1 << (lutShift - 1));
+    quint32 values[4];
+    for (int x = 0; x < width; ++x, input += Bytes, output += Bytes) {
+        lutPixel<R, G, B, A, Bytes, P>(lut, input, nodes, weights);
+        // weights fit in 16-bit, widening multiply accumulates all channels at once
+        uint32x4_t sum = vmull_n_u16(vld1_u16(nodes[0]), static_cast<quint16>(weights[0]));
+        sum = vmlal_n_u16(sum, vld1_u16(nodes[1]), static_cast<quint16>(weights[1]));
+        sum = vmlal_n_u16(sum, vld1_u16(nodes[2]), static_cast<quint16>(weights[2]));
+        sum = vmlal_n_u16(sum, vld1_u16(nodes[3]), static_cast<quint16>(weights[3]));
+        vst1q_u32(values, vshrq_n_u32(vaddq_u32(sum, round), lutShift));
+        lutStore<R, G, B, A, Bytes, P>(input, output, static_cast<int>(values[0]), static_cast<int>(values[1]),
+                                       static_cast<int>(values[2]));
+    }
+}
+#endif
+
+template<int R, int G, int B, int A, int Bytes, bool P = false>
+void
+lutLine(const Lut& lut, const uchar* input, uchar* output, int width)
+{
+#if defined(__SSE2__)
+    lutSSE2<R, G, B, A, Bytes, P>(lut, input, output, width);
+#elif defined(__ARM_NEON)
+    lutNEON<R, G, B, A, Bytes, P>(lut, input, output, width);
+#else
+    lutScalar<R, G, B, A, Bytes, P>(lut, input, output, width);
+#endif
+}
+
+bool
+lutFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGB32:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+    case QImage::Format_RGB888:
+    case QImage::Format_BGR888: return true;
+
+    default: return false;
+    }
+}
+
+void
+lutMap(const Lut& lut, QImage::Format format, const uchar* input, uchar* output, int width)
+{
+    // byte order in memory, 32-bit argb formats are bgra on little endian
+    switch (format) {
+    case QImage::Format_ARGB32:
+    case QImage::Format_RGB32: lutLine<2, 1, 0, 3, 4>(lut, input, output, width); break;
+
+    case QImage::Format_ARGB32_Premultiplied: lutLine<2, 1, 0, 3, 4, true>(lut, input, output, width); break;
+
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888: lutLine<0, 1, 2, 3, 4>(lut, input, output, width); break;
+
+    case QImage::Format_RGBA8888_Premultiplied: lutLine<0, 1, 2, 3, 4, true>(lut, input, output, width); break;
+
+    case QImage::Format_RGB888: lutLine<0, 1, 2, -1, 3>(lut, input, output, width); break;
+
+    case QImage::Format_BGR888: lutLine<2, 1, 0, -1, 3>(lut, input, output, width); break;
+
+    default: break;
+    }
+}
+
+// matrix-shaper pairs map through decode curves, one 3x3 matrix in linear light and
+// encode curves, encode nodes are spaced over the square root of linear light so steep
+// curve starts near black keep their precision
+const int matrixDecodeSize = 4096;  // 16-bit decode nodes, 8-bit values index directly
+const int matrixEncodeSize = 4096;
+const double matrixTolerance = 0.5;  // max deltaE 2000 against lcms, larger falls back to lcms
+const qint64 linkCacheSize = qint64(64) << 20;  // bytes, least recently used links are removed past it
+
+class Matrix {
+public:
+    Matrix(int depth)
+        : scale(depth == 8 ? 255.0f : 65535.0f)
+        , deltaE(0.0)
+    {
+        for (int c = 0; c < 3; ++c) {
+            decode[c].resize(depth == 8 ? 256 : matrixDecodeSize + 1);
+        }
+    }
+    float matrix[3][3];  // output rows
+    float scale;
+    std::vector<float> decode[3];
+    float encode[3][matrixEncodeSize + 1];  // in output scale
+    double deltaE;
+};
+
+inline float
+matrixDecode(const Matrix& matrix, int c, quint8 value)
+{
+    return matrix.decode[c][value];
+}
+
+inline float
+matrixDecode(const Matrix& matrix, int c, quint16 value)
+{
+    int position = value * matrixDecodeSize;
+    int index = std::min(position / 65535, matrixDecodeSize - 1);
+    float fraction = static_cast<float>(position - index * 65535) / 65535.0f;
+    const float* nodes = matrix.decode[c].data() + index;
+    return nodes[0] + (nodes[1] - nodes[0]) * fraction;
+}
+
+// linear rgb of four pixels, planar, to encode node indices and fractions per channel
+void
+matrixScalar(const Matrix& matrix, const float* linear, int* indices, float* fractions)
+{
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < 4; ++i) {
+            float value = matrix.matrix[c][0] * linear[i] + matrix.matrix[c][1] * linear[4 + i]
+                          + matrix.matrix[c][2] * linear[8 + i];
+            float position = std::sqrt(std::min(std::max(value, 0.0f), 1.0f)) * matrixEncodeSize;
+            int index = static_cast<int>(std::min(position, static_cast<float>(matrixEncodeSize - 1)));
+            indices[c * 4 + i] = index;
+            fractions[c * 4 + i] = position - static_cast<float>(index);
+        }
+    }
+}
+
+#if defined(__SSE2__)
+void
+matrixSSE2(const Matrix& matrix, const float* linear, int* indices, float* fractions)
+{
+    __m128 r = _mm_loadu_ps(linear);
+    __m128 g = _mm_loadu_ps(linear + 4);
+    __m128 b = _mm_loadu_ps(linear + 8);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 size = _mm_set1_ps(static_cast<float>(matrixEncodeSize));
+    const __m128 last = _mm_set1_ps(static_cast<float>(matrixEncodeSize - 1));
+    for (int c = 0; c < 3; ++c) {
+        __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix.matrix[c][0]), r),
+                                             _mm_mul_ps(_mm_set1_ps(matrix.matrix[c][1]), g)),
+                                  _mm_mul_ps(_mm_set1_ps(matrix.matrix[c][2]), b));
+        __m128 position = _mm_mul_ps(_mm_sqrt_ps(_mm_min_ps(_mm_max_ps(value, zero), one)), size);
+        __m128i index = _mm_cvttps_epi32(_mm_min_ps(position, last));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + c * 4), index);
+        _mm_storeu_ps(fractions + c * 4, _mm_sub_ps(position, _mm_cvtepi32_ps(index)));
+    }
+}
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+void
+matrixNEON(const Matrix& matrix, const float* linear, int* indices, float* fractions)
+{
+    float32x4_t r = vld1q_f32(linear);
+    float32x4_t g = vld1q_f32(linear + 4);
+    float32x4_t b = vld1q_f32(linear + 8);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t last = vdupq_n_f32(static_cast<float>(matrixEncodeSize - 1));
+    for (int c = 0; c < 3; ++c) {
+        float32x4_t value = vmulq_n_f32(r, matrix.matrix[c][0]);
+        value = vmlaq_n_f32(value, g, matrix.matrix[c][1]);
+        value = vmlaq_n_f32(value, b, matrix.matrix[c][2]);
+        float32x4_t position = vmulq_n_f32(vsqrtq_f32(vminq_f32(vmaxq_f32(value, zero), one)),
+                                           static_cast<float>(matrixEncodeSize));
+        int32x4_t index = vcvtq_s32_f32(vminq_f32(position, last));
+        vst1q_s32(indices + c * 4, index);
+        vst1q_f32(fractions + c * 4, vsubq_f32(position, vcvtq_f32_s32(index)));
+    }
+}
+#endif
+
+inline quint8
+matrixUnpremultiplied(quint8 value, quint8 alpha)
+{
+    return static_cast<quint8>(unpremultiplied(value, alpha));
+}
+
+inline quint16
+matrixUnpremultiplied(quint16 value, quint16 alpha)
+{
+    return alpha ? static_cast<quint16>(qMin<quint32>((value * 65535u + alpha / 2) / alpha, 65535)) : 0;
+}
+
+// premultiplied pixels are unpremultiplied before decoding and the encoded values
+// are scaled by alpha, alpha is carried through
+template<typename T, int R, int G, int B, int A, int Channels, bool P = false>
+void
+matrixLine(const Matrix& matrix, const uchar* input, uchar* output, int width)
+{
+    const T* in = reinterpret_cast<const T*>(input);
+    T* out = reinterpret_cast<T*>(output);
+    float linear[12];
+    int indices[12];
+    float fractions[12];
+    for (int x = 0; x < width; x += 4) {
+        int count = std::min(4, width - x);
+        for (int i = 0; i < 4; ++i) {
+            const T* pixel = in + (x + std::min(i, count - 1)) * Channels;
+            if (P) {
+                linear[i] = matrixDecode(matrix, 0, matrixUnpremultiplied(pixel[R], pixel[A]));
+                linear[4 + i] = matrixDecode(matrix, 1, matrixUnpremultiplied(pixel[G], pixel[A]));
+                linear[8 + i] = matrixDecode(matrix, 2, matrixUnpremultiplied(pixel[B], pixel[A]));
+            }
+            else {
+                linear[i] = matrixDecode(matrix, 0, pixel[R]);
+                linear[4 + i] = matrixDecode(matrix, 1, pixel[G]);
+                linear[8 + i] = matrixDecode(matrix, 2, pixel[B]);
+            }
+        }
+#if defined(__SSE2__)
+        matrixSSE2(matrix, linear, indices, fractions);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        matrixNEON(matrix, linear, indices, fractions);
+#else
+        matrixScalar(matrix, linear, indices, fractions);
+#endif
+        for (int i = 0; i < count; ++i) {
+            const T* source = in + (x + i) * Channels;
+            T* pixel = out + (x + i) * Channels;
+            float scale = 1.0f;
+            if (A >= 0) {
+                pixel[A] = source[A];
+                if (P) {
+                    scale = source[A] / matrix.scale;
+                }
+            }
+            const int offsets[3] = { R, G, B };
+            for (int c = 0; c < 3; ++c) {
+                const float* nodes = matrix.encode[c] + indices[c * 4 + i];
+                float value = nodes[0] + (nodes[1] - nodes[0]) * fractions[c * 4 + i];
+                pixel[offsets[c]] = static_cast<T>(value * scale + 0.5f);
+            }
+        }
+    }
+}
+
+int
+matrixDepth(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGB32:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+    case QImage::Format_RGB888:
+    case QImage::Format_BGR888: return 8;
+
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied: return 16;
+
+    default: return 0;
+    }
+}
+
+void
+matrixMap(const Matrix& matrix, QImage::Format format, const uchar* input, uchar* output, int width)
+{
+    // byte order in memory, 32-bit argb formats are bgra on little endian
+    switch (format) {
+    case QImage::Format_ARGB32:
+    case QImage::Format_RGB32: matrixLine<quint8, 2, 1, 0, 3, 4>(matrix, input, output, width); break;
+
+    case QImage::Format_ARGB32_Premultiplied:
+        matrixLine<quint8, 2, 1, 0, 3, 4, true>(matrix, input, output, width);
+        break;
+
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888: matrixLine<quint8, 0, 1, 2, 3, 4>(matrix, input, output, width); break;
+
+    case QImage::Format_RGBA8888_Premultiplied:
+        matrixLine<quint8, 0, 1, 2, 3, 4, true>(matrix, input, output, width);
+        break;
+
+    case QImage::Format_RGB888: matrixLine<quint8, 0, 1, 2, -1, 3>(matrix, input, output, width); break;
+
+    case QImage::Format_BGR888: matrixLine<quint8, 2, 1, 0, -1, 3>(matrix, input, output, width); break;
+
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+        matrixLine<quint16, 0, 1, 2, 3, 4>(matrix, input, output, width);
+        break;
+
+    case QImage::Format_RGBA64_Premultiplied:
+        matrixLine<quint16, 0, 1, 2, 3, 4, true>(matrix, input, output, width);
+        break;
+
+    default: break;
+    }
+}
+
+}  // namespace
+
 class ICCTransformPrivate : public QObject {
     Q_OBJECT
+public:
+    class Key {
+    public:
+        QString profile;
+        QString outProfile;
+        QImage::Format format;
+        int intent;
+        cmsUInt32Number flags;
+        QStringList via;  // profiles between input and output in composed transforms
+        bool operator==(const Key& other) const
+        {
+            return format == other.format && intent == other.intent && flags == other.flags
+                   && profile == other.profile && outProfile == other.outProfile && via == other.via;
+        }
+    };
+    class Context {
+    public:
+        Context()
+            : context(cmsCreateContext(nullptr, nullptr))
+        {}
+        ~Context() { cmsDeleteContext(context); }
+        cmsContext context;
+    };
+    class Profile {
+    public:
+        Profile(cmsHPROFILE profile, const QString& id, const QByteArray& data, const QSharedPointer<Context>& context)
+            : profile(profile)
+            , id(id)
+            , data(data)
+            , shaper(profile)
+            , context(context)
+        {}
+        ~Profile() { cmsCloseProfile(profile); }
+        cmsHPROFILE profile;
+        QString id;  // content id, see profileId
+        QByteArray data;  // icc bytes, opened again by link builds that must not hold the mutex
+        Shaper shaper;
+        QMutex mutex;  // lcms reads tags lazily, profiles are used by one thread at a time
+        QSharedPointer<Context> context;  // created in, deleted after the profile
+    };
+    class Parsed {
+    public:
+        qint64 size;
+        QDateTime modified;
+        QWeakPointer<Profile> profile;
+    };
+    class Counters {
+    public:
+        Counters(const Key& key)
+            : profile(key.profile)
+            , outProfile(key.outProfile)
+            , via(key.via)
+        {}
+        QString profile;
+        QString outProfile;
+        QStringList via;
+        QAtomicInteger<quint64> builds;
+        QAtomicInteger<qint64> buildTime;  // nanoseconds
+        QAtomicInteger<quint64> hits;
+        QAtomicInteger<quint64> pixels;
+        QAtomicInteger<qint64> mapTime;  // wall time, nanoseconds
+    };
+    class Transform {
+    public:
+        Transform(cmsHTRANSFORM transform, QImage::Format format)
+            : transform(transform)
+            , format(format)
+        {}
+        ~Transform()
+        {
+            if (transform) {
+                cmsDeleteTransform(transform);
+            }
+        }
+        cmsHTRANSFORM transform;  // null for the identity between equivalent profiles
+        QImage::Format format;
+        QList<QSharedPointer<Profile>> profiles;  // keeps parsed profiles alive while cached
+        QScopedPointer<Matrix> matrix;  // matrix-shaper pairs without a lut
+        QSharedPointer<Lut> lut;  // shared by the 8-bit formats of the chain
+        QScopedPointer<Memo> memo;
+        QSharedPointer<Counters> counters;  // shared by all formats of the profile pair
+        QSharedPointer<Context> context;  // created in, deleted after the transform
+        QAtomicInteger<quint64> touched;  // inserts when last marked as recently used in the cache
+    };
+    class Locker {
+    public:
+        Locker(const QList<QSharedPointer<Profile>>& profiles)
+        {
+            // lock in address order, a profile may appear more than once
+            for (const QSharedPointer<Profile>& profile : profiles) {
+                locked.append(profile.data());
+            }
+            std::sort(locked.begin(), locked.end(), std::less<Profile*>());
+            locked.erase(std::unique(locked.begin(), locked.end()), locked.end());
+            for (Profile* profile : locked) {
+                profile->mutex.lock();
+            }
+        }
+        ~Locker()
+        {
+            for (Profile* profile : locked) {
+                profile->mutex.unlock();
+            }
+        }
+        QList<Profile*> locked;
+    };
+    class Local {
+    public:
+        quint64 generation = 0;
+        QHash<Key, QWeakPointer<Transform>> transforms;  // weak, evicted transforms are not kept alive
+    };
+
 public:
     ICCTransformPrivate();
     ~ICCTransformPrivate();
+    QSharedPointer<Context> context();
     cmsUInt32Number mapFormat(QImage::Format format);
-    cmsHTRANSFORM mapTransform(const QString& profile, const QString& outProfile, QImage::Format format);
-    cmsHTRANSFORM mapTransform(const QColorSpace& colorSpace, const QString& outProfile, QImage::Format format);
-    QImage mapImage(QImage image, cmsHTRANSFORM transform);
+    QImage::Format mapWorkingFormat(QImage::Format format);
+    cmsUInt32Number mapFlags(QImage::Format format);
+    QSharedPointer<Transform> mapTransform(const QString& profile, const QString& outProfile, QImage::Format format);
+    QSharedPointer<Transform> mapTransform(const QColorSpace& colorSpace, const QString& outProfile,
+                                           QImage::Format format);
+    QSharedPointer<Profile> openProfile(const QString& profile);
+    QSharedPointer<Profile> openProfile(const QString& id, const QByteArray& data);
+    QList<float> linearTable(const QString& profile, int depth);
+    QString profileId(const QByteArray& data);
+    void reloadProfile(const QString& profile);
+    void removeTransforms(const QString& profile);
+    QSharedPointer<Transform> mapTransform(const QStringList& profiles, QImage::Format format);
+    QSharedPointer<Transform> createTransform(const Key& key, const QSharedPointer<Context>& context,
+                                              const QList<QSharedPointer<Profile>>& profiles);
+    QString linkPath(const Key& key, const QList<QSharedPointer<Profile>>& profiles);
+    cmsHPROFILE openLink(const QString& path, cmsContext context);
+    void writeLink(const QString& path, const Key& key, const QList<QSharedPointer<Profile>>& profiles);
+    void pruneLinks(const QString& directory);
+    QSharedPointer<Lut> bakeLut(const Key& key, cmsContext context, cmsHPROFILE* profiles, int count, int size,
+                                const QString& chain);
+    Matrix* bakeMatrix(const Key& key, cmsContext context, cmsHPROFILE* profiles, int count, const QString& pair);
+    double deltaE(const Key& key, cmsContext context, cmsHPROFILE* profiles, int count,
+                  const std::function<void(const uchar*, uchar*, int)>& map);
+    int mapBands(int width, int height);
+    void mapLines(const Transform* transform, const uchar* input, uchar* output, int width, int height,
+                  qsizetype inputStride, qsizetype outputStride, const std::function<bool()>& canceled = nullptr);
+    QImage mapImage(QImage image, const Transform* transform);
+    void mapImage(const QImage& image, QImage& destination, const Transform* transform);
+    void mapImage(const QImage& image, const QRect& rect, QImage& destination, const Transform* transform,
+                  const std::function<bool()>& canceled = nullptr);
     QRgb map(QRgb color, const QString& profile, const QString& outProfile);
+    bool map(const QRgb* colors, QRgb* mapped, qsizetype count, const QString& profile, const QString& outProfile);
+    QRgb map(QRgb color, const QColorSpace& colorSpace, const QString& outProfile);
+    bool mapColors(Transform* transform, const QRgb* colors, QRgb* mapped, qsizetype count);
+    QList<QRgb> map(const QList<QRgb>& colors, const QStringList& profiles, const QString& outProfile);
     QImage map(QImage image, const QString& profile, const QString& outProfile);
     QImage map(QImage image, const QColorSpace& colorSpace, const QString& outProfile);
+    bool map(const QImage& image, QImage& destination, const QString& profile, const QString& outProfile);
+    bool map(const QImage& image, QImage& destination, const QStringList& profiles);
+    bool map(const QImage& image, const QRect& rect, QImage& destination, const QStringList& profiles);
+    QFuture<QImage> mapAsync(const QImage& image, const std::function<QSharedPointer<Transform>()>& transform);
+    void prewarm(const QList<ICCTransform::Prewarm>& transforms);
+    QSharedPointer<Transform> cachedTransform(const Key& key);
+    QSharedPointer<Transform> insertTransform(const Key& key, Transform* transform, qint64 buildTime);
+    void invalidate();
 
 public:
+    // declaration order matters, the pool is destroyed first
     QString inputProfile;
     QString outputProfile;
-    QMap<QString, QMap<QImage::Format, QMap<QString, cmsHTRANSFORM>>> cache;
+    QString linkDirectory;
+    QSet<QString> linkWrites;  // paths being written on the pool
+    QMutex linkMutex;
+    QReadWriteLock linkDirectoryLock;
+    QReadWriteLock profileLock;
+    QHash<QString, Parsed> profiles;
+    QMutex profilesMutex;
+    QCache<Key, QSharedPointer<Transform>> cache;
+    QMutex cacheMutex;
+    QHash<QString, QSharedPointer<Counters>> counters;
+    QMutex countersMutex;
+    QHash<QString, QList<float>> linearTables;  // keyed by profile and depth
+    QHash<QString, double> matrixGates;  // matrix deltaE keyed by profile ids and intent, shared by formats
+    QMutex matrixMutex;
+    QHash<QString, QWeakPointer<Lut>> luts;  // baked luts keyed by profile ids, intent and size
+    QMutex lutMutex;
+    QMutex linearMutex;
+    QAtomicInteger<quint64> generation;
+    QAtomicInteger<quint64> inserts;
+    QAtomicInteger<quint64> hits;
+    QAtomicInteger<quint64> misses;
+    QAtomicInteger<quint64> evictions;
+    QAtomicInteger<quint64> colorHits;
+    QAtomicInteger<quint64> colorMisses;
+    QAtomicInt parallel;
+    QAtomicInt lutSize;
+    QAtomicInt warmup;
     QPointer<ICCTransform> transform;
+    QThreadPool pool;
 };
 
-ICCTransformPrivate::ICCTransformPrivate() {}
+size_t
+qHash(const ICCTransformPrivate::Key& key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.profile, key.outProfile, static_cast<int>(key.format), key.intent, key.flags,
+                      key.via);
+}
+
+ICCTransformPrivate::ICCTransformPrivate()
+    : cache(64)
+    , generation(1)
+    , inserts(0)
+    , hits(0)
+    , misses(0)
+    , evictions(0)
+    , colorHits(0)
+    , colorMisses(0)
+    , parallel(true)
+    , lutSize(0)
+    , warmup(0)
+{}
 
 ICCTransformPrivate::~ICCTransformPrivate()
 {
-    for (QString profile : cache.keys()) {
-        for (QImage::Format format : cache[profile].keys()) {
-            for (QString outputProfile : cache[profile][format].keys()) {
-                cmsDeleteTransform(cache[profile][format][outputProfile]);
+    warmup.fetchAndAddRelaxed(1);  // stops a running warm-up
+    pool.waitForDone();
+}
+
+QSharedPointer<ICCTransformPrivate::Context>
+ICCTransformPrivate::context()
+{
+    // one lcms context per thread, shared with the profiles and transforms
+    // created in it and deleted with the last of them or the thread
+    static thread_local QSharedPointer<Context> context;
+    if (!context) {
+        context.reset(new Context());
+    }
+    return context;
+}
+
+cmsUInt32Number
+ICCTransformPrivate::mapFormat(QImage::Format format)
+{
+    // premultiplied formats are unpremultiplied and premultiplied again by lcms
+    const cmsUInt32Number premultiplied = PREMUL_SH(1);
+    switch (format) {
+    case QImage::Format_ARGB32:
+    case QImage::Format_RGB32: return TYPE_BGRA_8;
+
+    case QImage::Format_ARGB32_Premultiplied: return TYPE_BGRA_8 | premultiplied;
+
+    case QImage::Format_RGB888: return TYPE_RGB_8;
+
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888: return TYPE_RGBA_8;
+
+    case QImage::Format_RGBA8888_Premultiplied: return TYPE_RGBA_8 | premultiplied;
+
+    case QImage::Format_Grayscale8: return TYPE_GRAY_8;
+
+    case QImage::Format_Grayscale16: return TYPE_GRAY_16;
+
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBX64: return TYPE_RGBA_16;
+
+    case QImage::Format_RGBA64_Premultiplied: return TYPE_RGBA_16 | premultiplied;
+
+    case QImage::Format_RGBX16FPx4:
+    case QImage::Format_RGBA16FPx4: return TYPE_RGBA_HALF_FLT;
+
+    case QImage::Format_RGBA16FPx4_Premultiplied: return TYPE_RGBA_HALF_FLT | premultiplied;
+
+    case QImage::Format_RGBX32FPx4:
+    case QImage::Format_RGBA32FPx4: return TYPE_RGBA_FLT;
+
+    case QImage::Format_RGBA32FPx4_Premultiplied: return TYPE_RGBA_FLT | premultiplied;
+
+    case QImage::Format_BGR888: return TYPE_BGR_8;
+
+    default: return 0;
+    }
+}
+
+QImage::Format
+ICCTransformPrivate::mapWorkingFormat(QImage::Format format)
+{
+    // lcms has no packed 10-bit layouts, these are mapped at 16-bit
+    switch (format) {
+    case QImage::Format_A2RGB30_Premultiplied:
+    case QImage::Format_A2BGR30_Premultiplied: return QImage::Format_RGBA64_Premultiplied;
+
+    case QImage::Format_RGB30:
+    case QImage::Format_BGR30: return QImage::Format_RGBX64;
+
+    default: return format;
+    }
+}
+
+cmsUInt32Number
+ICCTransformPrivate::mapFlags(QImage::Format format)
+{
+    // alpha and padding channels are left unwritten by lcms unless copied
+    return (T_EXTRA(mapFormat(format)) ? cmsFLAGS_COPY_ALPHA : 0);
+}
+
+QFuture<QImage>
+ICCTransformPrivate::mapAsync(const QImage& image, const std::function<QSharedPointer<Transform>()>& transform)
+{
+    // the transform is looked up on the worker, cancellation is checked before
+    // and between row bands and a canceled future gets no result
+    QSharedPointer<QPromise<QImage>> promise(new QPromise<QImage>());
+    QFuture<QImage> future = promise->future();
+    promise->start();
+    pool.start([this, promise, image, transform] {
+        auto canceled = [&promise] { return promise->isCanceled(); };
+        if (!canceled()) {
+            QSharedPointer<Transform> mapTransform = transform();
+            QImage mapped;
+            if (mapTransform) {
+                mapImage(image, image.rect(), mapped, mapTransform.data(), canceled);
+            }
+            else {
+                mapped = image;
+            }
+            if (!canceled()) {
+                promise->addResult(mapped);
+            }
+        }
+        promise->finish();
+    });
+    return future;
+}
+
+void
+ICCTransformPrivate::prewarm(const QList<ICCTransform::Prewarm>& transforms)
+{
+    // a newer warm-up supersedes this one, checked between transforms
+    int id = warmup.fetchAndAddRelaxed(1) + 1;
+    pool.start([this, id, transforms] {
+        for (const ICCTransform::Prewarm& prewarm : transforms) {
+            if (warmup.loadRelaxed() != id) {
+                return;
+            }
+            // keyed as the map calls, working formats for images and pairs for two profiles
+            mapTransform(prewarm.profiles, mapWorkingFormat(prewarm.format));
+        }
+    });
+}
+
+QSharedPointer<ICCTransformPrivate::Transform>
+ICCTransformPrivate::cachedTransform(const Key& key)
+{
+    // lock-free path, each thread keeps weak references to the transforms it
+    // has used, evicted transforms are deleted with their last user and stale
+    // entries dropped when the shared cache evicts or is cleared
+    static thread_local Local local;
+    quint64 current = generation.loadAcquire();
+    if (local.generation != current) {
+        local.transforms.clear();
+        local.generation = current;
+    }
+    QSharedPointer<Transform> transform = local.transforms.value(key).toStrongRef();
+    if (transform && transform->touched.loadRelaxed() != inserts.loadRelaxed()) {
+        // entries are only evicted by inserts, local hits mark the shared entry as
+        // most recently used once per insert so transforms in use are not evicted
+        QMutexLocker locker(&cacheMutex);
+        cache.object(key);
+        transform->touched.storeRelaxed(inserts.loadRelaxed());
+    }
+    if (!transform) {
+        QMutexLocker locker(&cacheMutex);
+        QSharedPointer<Transform>* cached = cache.object(key);  // also marks the entry as most recently used
+        if (cached) {
+            transform = *cached;
+            transform->touched.storeRelaxed(inserts.loadRelaxed());
+        }
+    }
+    if (transform) {
+        local.transforms.insert(key, transform);
+        hits.fetchAndAddRelaxed(1);
+        transform->counters->hits.fetchAndAddRelaxed(1);
+    }
+    else {
+        misses.fetchAndAddRelaxed(1);
+    }
+    return transform;
+}
+
+QSharedPointer<ICCTransformPrivate::Transform>
+ICCTransformPrivate::insertTransform(const Key& key, Transform* transform, qint64 buildTime)
+{
+    QSharedPointer<Transform> inserted(transform);
+    {
+        // counters are kept per profile pair for the lifetime of the instance, formats share them
+        QString pair = QStringList({ key.profile, key.via.join('\n'), key.outProfile }).join('\n');
+        QMutexLocker locker(&countersMutex);
+        QSharedPointer<Counters>& pairCounters = counters[pair];
+        if (!pairCounters) {
+            pairCounters.reset(new Counters(key));
+        }
+        transform->counters = pairCounters;
+    }
+    transform->counters->builds.fetchAndAddRelaxed(1);
+    transform->counters->buildTime.fetchAndAddRelaxed(buildTime);
+    QMutexLocker locker(&cacheMutex);
+    QSharedPointer<Transform>* cached = cache.object(key);
+    if (cached) {
+        return *cached;  // built concurrently by another thread, use the cached one
+    }
+    // least recently used entries are deleted past the limit
+    qsizetype count = cache.count();
+    transform->touched.storeRelaxed(inserts.fetchAndAddRelaxed(1) + 1);
+    cache.insert(key, new QSharedPointer<Transform>(inserted));
+    qsizetype evicted = count + 1 - cache.count();
+    if (evicted > 0) {
+        evictions.fetchAndAddRelaxed(evicted);
+        generation.fetchAndAddRelease(1);
+    }
+    return inserted;
+}
+
+void
+ICCTransformPrivate::invalidate()
+{
+    generation.fetchAndAddRelease(1);
+}
+
+QSharedPointer<ICCTransformPrivate::Profile>
+ICCTransformPrivate::openProfile(const QString& profile)
+{
+    // parsed profiles are shared by path while a cached transform uses them,
+    // a changed size or modification time means the file was rewritten
+    QFileInfo info(profile);
+    qint64 size = info.size();
+    QDateTime modified = info.lastModified();
+    bool changed = false;
+    QSharedPointer<Profile> parsed;
+    {
+        QMutexLocker locker(&profilesMutex);
+        auto it = profiles.constFind(profile);
+        if (it != profiles.constEnd()) {
+            if (it->size == size && it->modified == modified) {
+                parsed = it->profile.toStrongRef();
+            }
+            else {
+                changed = true;
+            }
+        }
+        if (!parsed) {
+            QFile file(profile);
+            QByteArray data = file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+            QSharedPointer<Context> context = this->context();
+            cmsHPROFILE cmsProfile = data.size() ? cmsOpenProfileFromMemTHR(context->context, data.constData(),
+                                                                            static_cast<cmsUInt32Number>(data.size()))
+                                                 : nullptr;
+            if (cmsProfile) {
+                parsed.reset(new Profile(cmsProfile, profileId(data), data, context));
+                profiles.insert(profile, Parsed { size, modified, parsed });
+            }
+            else {
+                profiles.remove(profile);
+            }
+            profiles.removeIf([](const auto& it) { return it.value().profile.isNull(); });
+        }
+    }
+    if (changed) {
+        removeTransforms(profile);
+    }
+    return parsed;
+}
+
+QSharedPointer<ICCTransformPrivate::Profile>
+ICCTransformPrivate::openProfile(const QString& id, const QByteArray& data)
+{
+    // content keyed profiles never change, shared while a cached transform uses them
+    QMutexLocker locker(&profilesMutex);
+    QSharedPointer<Profile> parsed = profiles.value(id).profile.toStrongRef();
+    if (!parsed) {
+        QSharedPointer<Context> context = this->context();
+        cmsHPROFILE cmsProfile = cmsOpenProfileFromMemTHR(context->context, data.constData(),
+                                                          static_cast<cmsUInt32Number>(data.size()));
+        if (cmsProfile) {
+            parsed.reset(new Profile(cmsProfile, id, data, context));
+            profiles.insert(id, Parsed { data.size(), QDateTime(), parsed });
+        }
+        profiles.removeIf([](const auto& it) { return it.value().profile.isNull(); });
+    }
+    return parsed;
+}
+
+QList<float>
+ICCTransformPrivate::linearTable(const QString& profile, int depth)
+{
+    QString key = QString("%1\n%2").arg(profile).arg(depth);
+    {
+        QMutexLocker locker(&linearMutex);
+        auto it = linearTables.constFind(key);
+        if (it != linearTables.constEnd()) {
+            return *it;
+        }
+    }
+    // each code value evaluated once through the tone curves of the profile
+    const int size = 1 << depth;
+    QList<float> table(size * 3);
+    QSharedPointer<Profile> parsed = openProfile(profile);
+    cmsToneCurve* srgb = nullptr;
+    {
+        const cmsTagSignature curveTags[3] = { cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag };
+        QMutexLocker locker(parsed ? &parsed->mutex : nullptr);
+        bool rgb = parsed && cmsGetColorSpace(parsed->profile) == cmsSigRgbData;
+        const cmsToneCurve* curves[3];
+        for (int c = 0; c < 3; ++c) {
+            curves[c] = rgb ? static_cast<const cmsToneCurve*>(cmsReadTag(parsed->profile, curveTags[c])) : nullptr;
+        }
+        if (!curves[0] || !curves[1] || !curves[2]) {
+            const cmsFloat64Number parameters[5] = { 2.4, 1.0 / 1.055, 0.055 / 1.055, 1.0 / 12.92, 0.04045 };
+            srgb = cmsBuildParametricToneCurve(context()->context, 4, parameters);
+            curves[0] = curves[1] = curves[2] = srgb;
+        }
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i < size; ++i) {
+                cmsFloat32Number value = static_cast<cmsFloat32Number>(i) / (size - 1);
+                table[c * size + i] = curves[c] ? cmsEvalToneCurveFloat(curves[c], value) : value;
+            }
+        }
+    }
+    if (srgb) {
+        cmsFreeToneCurve(srgb);
+    }
+    QMutexLocker locker(&linearMutex);
+    linearTables.insert(key, table);
+    return table;
+}
+
+QString
+ICCTransformPrivate::profileId(const QByteArray& data)
+{
+    // use the header profile id when set, an md5 of the profile otherwise
+    const int offset = 84;
+    const int length = 16;
+    QByteArray id = data.mid(offset, length);
+    if (id.size() != length || id.count('\0') == length) {
+        id = QCryptographicHash::hash(data, QCryptographicHash::Md5);
+    }
+    return QString("icc:%1").arg(QString::fromLatin1(id.toHex()));
+}
+
+void
+ICCTransformPrivate::reloadProfile(const QString& profile)
+{
+    QFileInfo info(profile);
+    {
+        QMutexLocker locker(&profilesMutex);
+        auto it = profiles.constFind(profile);
+        if (it == profiles.constEnd() || (it->size == info.size() && it->modified == info.lastModified())) {
+            return;
+        }
+        profiles.erase(it);
+    }
+    removeTransforms(profile);
+}
+
+void
+ICCTransformPrivate::removeTransforms(const QString& profile)
+{
+    QMutexLocker locker(&cacheMutex);
+    const QList<Key> keys = cache.keys();
+    for (const Key& key : keys) {
+        if (key.profile == profile || key.outProfile == profile || key.via.contains(profile)) {
+            cache.remove(key);
+        }
+    }
+    {
+        QMutexLocker linearLocker(&linearMutex);
+        linearTables.removeIf([&profile](const auto& it) { return it.key().section('\n', 0, 0) == profile; });
+    }
+    invalidate();
+}
+
+QSharedPointer<ICCTransformPrivate::Transform>
+ICCTransformPrivate::mapTransform(const QString& profile, const QString& outProfile, QImage::Format format)
+{
+    if (!mapFormat(format)) {
+        return QSharedPointer<Transform>();  // no lcms layout for the format
+    }
+    Key key { profile, outProfile, format, INTENT_PERCEPTUAL, mapFlags(format) };
+    QSharedPointer<Transform> transform = cachedTransform(key);
+    if (!transform) {
+        QSharedPointer<Profile> parsedProfile = openProfile(profile);
+        QSharedPointer<Profile> parsedOutProfile = openProfile(outProfile);
+        if (parsedProfile && parsedOutProfile) {
+            transform = createTransform(key, context(), { parsedProfile, parsedOutProfile });
+        }
+    }
+    return transform;
+}
+
+QSharedPointer<ICCTransformPrivate::Transform>
+ICCTransformPrivate::mapTransform(const QColorSpace& colorSpace, const QString& outProfile, QImage::Format format)
+{
+    if (!mapFormat(format)) {
+        return QSharedPointer<Transform>();  // no lcms layout for the format
+    }
+    // embedded profiles are keyed by content, descriptions are neither unique nor stable
+    QByteArray data = colorSpace.iccProfile();
+    if (data.isEmpty()) {
+        return QSharedPointer<Transform>();
+    }
+    Key key { profileId(data), outProfile, format, INTENT_PERCEPTUAL, mapFlags(format) };
+    QSharedPointer<Transform> transform = cachedTransform(key);
+    if (!transform) {
+        QSharedPointer<Profile> parsedProfile = openProfile(key.profile, data);
+        QSharedPointer<Profile> parsedOutProfile = openProfile(outProfile);
+        if (parsedProfile && parsedOutProfile) {
+            transform = createTransform(key, context(), { parsedProfile, parsedOutProfile });
+        }
+    }
+    return transform;
+}
+
+QSharedPointer<ICCTransformPrivate::Transform>
+ICCTransformPrivate::mapTransform(const QStringList& profiles, QImage::Format format)
+{
+    // repeated profiles are no-ops in the chain, a single profile is no transform
+    QStringList chain;
+    for (const QString& profile : profiles) {
+        if (chain.isEmpty() || chain.last() != profile) {
+            chain.append(profile);
+        }
+    }
+    if (chain.count() < 2) {
+        return QSharedPointer<Transform>();
+    }
+    if (chain.count() == 2) {
+        return mapTransform(chain.first(), chain.last(), format);
+    }
+    if (!mapFormat(format)) {
+        return QSharedPointer<Transform>();
+    }
+    Key key { chain.first(), chain.last(), format, INTENT_PERCEPTUAL, mapFlags(format),
+              chain.mid(1, chain.count() - 2) };
+    QSharedPointer<Transform> transform = cachedTransform(key);
+    if (!transform) {
+        QList<QSharedPointer<Profile>> parsed;
+        for (const QString& profile : chain) {
+            QSharedPointer<Profile> parsedProfile = openProfile(profile);
+            if (!parsedProfile) {
+                return transform;
+            }
+            parsed.append(parsedProfile);
+        }
+        transform = createTransform(key, context(), parsed);
+    }
+    return transform;
+}
+
+QSharedPointer<ICCTransformPrivate::Transform>
+ICCTransformPrivate::createTransform(const Key& key, const QSharedPointer<Context>& context,
+                                     const QList<QSharedPointer<Profile>>& profiles)
+{
+    QElapsedTimer timer;
+    timer.start();
+    Transform* transform = nullptr;
+    {
+        Locker locker(profiles);
+        // profiles equivalent to the one before are no-ops in the chain
+        QList<QSharedPointer<Profile>> chain;
+        QVarLengthArray<cmsHPROFILE, 4> handles;
+        for (const QSharedPointer<Profile>& profile : profiles) {
+            if (chain.isEmpty() || !chain.last()->shaper.equivalent(profile->shaper)) {
+                chain.append(profile);
+                handles.append(profile->profile);
+            }
+        }
+        if (handles.count() == 1) {
+            transform = new Transform(nullptr, key.format);  // identity, pixels are copied as is
+            transform->profiles = profiles;
+            transform->context = context;
+            return insertTransform(key, transform, timer.nsecsElapsed());
+        }
+        int count = static_cast<int>(handles.count());
+        cmsHTRANSFORM cmsTransform = nullptr;
+        QString path = linkPath(key, chain);
+        if (path.length()) {
+            cmsHPROFILE link = openLink(path, context->context);
+            if (link) {
+                cmsTransform = cmsCreateTransformTHR(context->context, link, mapFormat(key.format), nullptr,
+                                                     mapFormat(key.format), key.intent, key.flags);
+                cmsCloseProfile(link);
+            }
+            else {
+                // precalculated on the pool, this transform maps from the profiles
+                QMutexLocker locker(&linkMutex);
+                if (!linkWrites.contains(path)) {
+                    linkWrites.insert(path);
+                    pool.start([this, path, key, chain] { writeLink(path, key, chain); });
+                }
             }
         }
+        if (!cmsTransform) {
+            cmsTransform = cmsCreateMultiprofileTransformTHR(context->context, handles.data(), count,
+                                                             mapFormat(key.format), mapFormat(key.format),
+                                                             key.intent, key.flags);
+        }
+        if (!cmsTransform) {
+            return QSharedPointer<Transform>();
+        }
+        transform = new Transform(cmsTransform, key.format);
+        transform->profiles = profiles;
+        transform->context = context;
+        if (key.format == QImage::Format_RGB32) {
+            transform->memo.reset(new Memo());  // color transforms
+        }
+        // an enabled lut is used as asked, matrix-shaper pairs otherwise map natively,
+        // colors map through the memo and never use the matrix
+        int size = lutSize.loadRelaxed();
+        if (size > 0 && lutFormat(key.format)) {
+            QStringList ids;
+            for (const QSharedPointer<Profile>& profile : chain) {
+                ids.append(profile->id);
+            }
+            QString name = QString("%1 %2").arg(ids.join(' ')).arg(key.intent);
+            transform->lut = bakeLut(key, context->context, handles.data(), count, size, name);
+        }
+        if (!transform->lut && !transform->memo) {
+            QString pair = QString("%1 %2 %3").arg(chain.first()->id).arg(chain.last()->id).arg(key.intent);
+            transform->matrix.reset(bakeMatrix(key, context->context, handles.data(), count, pair));
+        }
     }
-    cache.clear();
+    return insertTransform(key, transform, timer.nsecsElapsed());
 }
 
-cmsUInt32Number
-ICCTransformPrivate::mapFormat(QImage::Format format)
+QString
+ICCTransformPrivate::linkPath(const Key& key, const QList<QSharedPointer<Profile>>& profiles)
 {
-    switch (format) {
-    case QImage::Format_ARGB32:
-    case QImage::Format_ARGB32_Premultiplied:
-    case QImage::Format_RGB32: return TYPE_BGRA_8;
-
-    case QImage::Format_RGB888: return TYPE_RGB_8;
-
-    case QImage::Format_RGBX8888:
-    case QImage::Format_RGBA8888: return TYPE_RGBA_8;
+    QString directory;
+    {
+        QReadLocker locker(&linkDirectoryLock);
+        directory = linkDirectory;
+    }
+    // float pipelines are unbounded and would be clipped by a device-link lut,
+    // matrix-shaper chains are optimized by lcms into exact curves and a matrix
+    bool shapers = std::all_of(profiles.begin(), profiles.end(),
+                               [](const QSharedPointer<Profile>& profile) { return profile->shaper.valid; });
+    if (directory.isEmpty() || T_FLOAT(mapFormat(key.format)) || shapers) {
+        return QString();
+    }
+    // links have no formatters, one link serves every format of the chain
+    QStringList ids;
+    for (const QSharedPointer<Profile>& profile : profiles) {
+        ids.append(profile->id);
+    }
+    QString name = QString("%1 %2 %3").arg(ids.join(' ')).arg(key.intent).arg(LCMS_VERSION);
+    QByteArray hash = QCryptographicHash::hash(name.toUtf8(), QCryptographicHash::Md5);
+    return QDir(directory).filePath(QString::fromLatin1(hash.toHex()) + ".icc");
+}
 
-    case QImage::Format_Grayscale8: return TYPE_GRAY_8;
+cmsHPROFILE
+ICCTransformPrivate::openLink(const QString& path, cmsContext context)
+{
+    // reads touch the modification time, pruning removes the least recently used
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+    QByteArray data = file.readAll();
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    return cmsOpenProfileFromMemTHR(context, data.constData(), static_cast<cmsUInt32Number>(data.size()));
+}
 
-    case QImage::Format_Grayscale16: return TYPE_GRAY_16;
+void
+ICCTransformPrivate::writeLink(const QString& path, const Key& key, const QList<QSharedPointer<Profile>>& profiles)
+{
+    // precalculated off the map path and read back by the next build of the chain,
+    // formatters are left out so the pipeline is resampled into a saveable lut
+    auto done = qScopeGuard([this, &path] {
+        QMutexLocker locker(&linkMutex);
+        linkWrites.remove(path);
+    });
+    // the profiles are opened again in this thread's context so the slow build
+    // does not hold their mutexes against transforms built meanwhile
+    QSharedPointer<Context> context = this->context();
+    QVarLengthArray<cmsHPROFILE, 4> handles;
+    auto closed = qScopeGuard([&handles] {
+        for (cmsHPROFILE handle : handles) {
+            cmsCloseProfile(handle);
+        }
+    });
+    for (const QSharedPointer<Profile>& profile : profiles) {
+        cmsHPROFILE handle = cmsOpenProfileFromMemTHR(context->context, profile->data.constData(),
+                                                      static_cast<cmsUInt32Number>(profile->data.size()));
+        if (!handle) {
+            return;
+        }
+        handles.append(handle);
+    }
+    cmsHTRANSFORM transform = cmsCreateMultiprofileTransformTHR(context->context, handles.data(),
+                                                                static_cast<int>(handles.count()), 0, 0, key.intent,
+                                                                cmsFLAGS_HIGHRESPRECALC);
+    if (!transform) {
+        return;
+    }
+    cmsHPROFILE link = cmsTransform2DeviceLink(transform, 4.3, 0);
+    cmsDeleteTransform(transform);
+    if (!link) {
+        return;
+    }
+    cmsUInt32Number size = 0;
+    if (cmsSaveProfileToMem(link, nullptr, &size) && size) {
+        QByteArray data(static_cast<qsizetype>(size), Qt::Uninitialized);
+        QSaveFile save(path);
+        if (cmsSaveProfileToMem(link, data.data(), &size) && QDir().mkpath(QFileInfo(path).absolutePath())
+            && save.open(QIODevice::WriteOnly)) {
+            save.write(data);
+            save.commit();
+        }
+    }
+    cmsCloseProfile(link);
+    pruneLinks(QFileInfo(path).absolutePath());
+}
 
-    case QImage::Format_RGBA64:
-    case QImage::Format_RGBX64: return TYPE_RGBA_16;
+void
+ICCTransformPrivate::pruneLinks(const QString& directory)
+{
+    // newest first, links past the size limit are the least recently used
+    const QFileInfoList links = QDir(directory).entryInfoList({ "*.icc" }, QDir::Files, QDir::Time);
+    qint64 size = 0;
+    for (const QFileInfo& link : links) {
+        size += link.size();
+        if (size > linkCacheSize) {
+            QFile::remove(link.absoluteFilePath());
+        }
+    }
+}
 
-    case QImage::Format_BGR888: return TYPE_BGR_8;
+QSharedPointer<Lut>
+ICCTransformPrivate::bakeLut(const Key& key, cmsContext context, cmsHPROFILE* profiles, int count, int size,
+                             const QString& chain)
+{
+    // nodes hold rgb whatever the format, one lut serves every 8-bit format of the chain
+    QString name = QString("%1 %2").arg(chain).arg(size);
+    {
+        QMutexLocker locker(&lutMutex);
+        QSharedPointer<Lut> shared = luts.value(name).toStrongRef();
+        if (shared) {
+            return shared;
+        }
+    }
+    // sample the full pipeline at 16-bit on the grid nodes
+    cmsHTRANSFORM grid = cmsCreateMultiprofileTransformTHR(context, profiles, count, TYPE_RGB_16, TYPE_RGB_16,
+                                                           key.intent, 0);
+    if (!grid) {
+        return QSharedPointer<Lut>();
+    }
+    QSharedPointer<Lut> lut(new Lut(size));
+    int nodes = size * size * size;
+    std::vector<quint16> input(static_cast<size_t>(nodes) * 3);
+    std::vector<quint16> output(static_cast<size_t>(nodes) * 3);
+    for (int r = 0, i = 0; r < size; ++r) {
+        for (int g = 0; g < size; ++g) {
+            for (int b = 0; b < size; ++b, i += 3) {
+                input[i] = static_cast<quint16>((r * 65535 + (size - 1) / 2) / (size - 1));
+                input[i + 1] = static_cast<quint16>((g * 65535 + (size - 1) / 2) / (size - 1));
+                input[i + 2] = static_cast<quint16>((b * 65535 + (size - 1) / 2) / (size - 1));
+            }
+        }
+    }
+    cmsDoTransform(grid, input.data(), output.data(), static_cast<cmsUInt32Number>(nodes));
+    cmsDeleteTransform(grid);
+    for (int i = 0; i < nodes; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            quint32 value = output[i * 3 + c];
+            lut->table[i * 4 + c] = static_cast<quint16>((value * (255 << lutValueBits) + 32767) / 65535);
+        }
+    }
+    lut->deltaE = deltaE(key, context, profiles, count, [&lut](const uchar* input, uchar* output, int width) {
+        lutScalar<0, 1, 2, -1, 3>(*lut, input, output, width);
+    });
+    QMutexLocker locker(&lutMutex);
+    luts.removeIf([](const auto& it) { return it.value().isNull(); });
+    luts.insert(name, lut);
+    return lut;
+}
 
-    default: return 0;
+Matrix*
+ICCTransformPrivate::bakeMatrix(const Key& key, cmsContext context, cmsHPROFILE* profiles, int count,
+                                const QString& pair)
+{
+    // matrix-shaper pairs only, absolute colorimetric and black point compensation
+    // scale in xyz and stay with lcms
+    int depth = matrixDepth(key.format);
+    if (!depth || count != 2 || key.intent == INTENT_ABSOLUTE_COLORIMETRIC
+        || (key.flags & cmsFLAGS_BLACKPOINTCOMPENSATION)) {
+        return nullptr;
+    }
+    // the deltaE gate is measured by the first format built for the pair
+    double gate = -1.0;
+    {
+        QMutexLocker locker(&matrixMutex);
+        gate = matrixGates.value(pair, -1.0);
+    }
+    if (gate > matrixTolerance) {
+        return nullptr;
+    }
+    const cmsTagSignature colorantTags[3] = { cmsSigRedColorantTag, cmsSigGreenColorantTag, cmsSigBlueColorantTag };
+    const cmsTagSignature curveTags[3] = { cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag };
+    double colorants[2][3][3];  // xyz rows, rgb columns
+    const cmsToneCurve* curves[2][3];
+    for (int p = 0; p < 2; ++p) {
+        if (!matrixShaper(profiles[p], key.intent)) {
+            return nullptr;
+        }
+        for (int c = 0; c < 3; ++c) {
+            const cmsCIEXYZ* colorant = static_cast<const cmsCIEXYZ*>(cmsReadTag(profiles[p], colorantTags[c]));
+            curves[p][c] = static_cast<const cmsToneCurve*>(cmsReadTag(profiles[p], curveTags[c]));
+            if (!colorant || !curves[p][c]) {
+                return nullptr;
+            }
+            colorants[p][0][c] = colorant->X;
+            colorants[p][1][c] = colorant->Y;
+            colorants[p][2][c] = colorant->Z;
+        }
+    }
+    // inverse of the output colorants by cofactors
+    const double(&o)[3][3] = colorants[1];
+    double inverse[3][3] = {
+        { o[1][1] * o[2][2] - o[1][2] * o[2][1], o[0][2] * o[2][1] - o[0][1] * o[2][2],
+          o[0][1] * o[1][2] - o[0][2] * o[1][1] },
+        { o[1][2] * o[2][0] - o[1][0] * o[2][2], o[0][0] * o[2][2] - o[0][2] * o[2][0],
+          o[0][2] * o[1][0] - o[0][0] * o[1][2] },
+        { o[1][0] * o[2][1] - o[1][1] * o[2][0], o[0][1] * o[2][0] - o[0][0] * o[2][1],
+          o[0][0] * o[1][1] - o[0][1] * o[1][0] }
+    };
+    double determinant = o[0][0] * inverse[0][0] + o[0][1] * inverse[1][0] + o[0][2] * inverse[2][0];
+    if (qAbs(determinant) < 1e-9) {
+        return nullptr;
     }
+    QScopedPointer<Matrix> matrix(new Matrix(depth));
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            double sum = 0.0;
+            for (int i = 0; i < 3; ++i) {
+                sum += inverse[r][i] / determinant * colorants[0][i][c];
+            }
+            matrix->matrix[r][c] = static_cast<float>(sum);
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        std::vector<float>& decode = matrix->decode[c];
+        int last = static_cast<int>(decode.size()) - 1;
+        for (int i = 0; i <= last; ++i) {
+            decode[i] = cmsEvalToneCurveFloat(curves[0][c], static_cast<cmsFloat32Number>(i) / last);
+        }
+        cmsToneCurve* reversed = cmsReverseToneCurve(curves[1][c]);
+        if (!reversed) {
+            return nullptr;
+        }
+        for (int i = 0; i <= matrixEncodeSize; ++i) {
+            float position = static_cast<float>(i) / matrixEncodeSize;
+            float value = cmsEvalToneCurveFloat(reversed, position * position);
+            matrix->encode[c][i] = std::min(std::max(value, 0.0f), 1.0f) * matrix->scale;
+        }
+        cmsFreeToneCurve(reversed);
+    }
+    if (gate < 0) {
+        gate = deltaE(key, context, profiles, count, [&matrix](const uchar* input, uchar* output, int width) {
+            matrixLine<quint8, 0, 1, 2, -1, 3>(*matrix, input, output, width);
+        });
+        QMutexLocker locker(&matrixMutex);
+        matrixGates.insert(pair, gate);
+    }
+    matrix->deltaE = gate;
+    if (matrix->deltaE > matrixTolerance) {
+        return nullptr;
+    }
+    return matrix.take();
 }
 
-cmsHTRANSFORM
-ICCTransformPrivate::mapTransform(const QString& profile, const QString& outProfile, QImage::Format format)
+double
+ICCTransformPrivate::deltaE(const Key& key, cmsContext context, cmsHPROFILE* profiles, int count,
+                            const std::function<void(const uchar*, uchar*, int)>& map)
 {
-    if (!cache.contains(profile)) {
-        cache.insert(profile, QMap<QImage::Format, QMap<QString, cmsHTRANSFORM>>());
+    // max deltaE 2000 against the 8-bit lcms transform, sampled off the grid
+    // nodes and measured in lab through the output profile
+    double deltaE = 0.0;
+    cmsHPROFILE lab = cmsCreateLab4ProfileTHR(context, nullptr);
+    cmsHTRANSFORM reference = cmsCreateMultiprofileTransformTHR(context, profiles, count, TYPE_RGB_8, TYPE_RGB_8,
+                                                                key.intent, 0);
+    cmsHTRANSFORM measure = lab ? cmsCreateTransformTHR(context, profiles[count - 1], TYPE_RGB_8, lab, TYPE_Lab_DBL,
+                                                        INTENT_RELATIVE_COLORIMETRIC, 0)
+                                : nullptr;
+    if (reference && measure) {
+        const int levels = 32;
+        int samples = levels * levels * levels;
+        std::vector<uchar> colors(static_cast<size_t>(samples) * 3);
+        for (int i = 0; i < samples; ++i) {
+            colors[i * 3] = static_cast<uchar>(((i / (levels * levels)) * 255 + 3) / (levels - 1));
+            colors[i * 3 + 1] = static_cast<uchar>((((i / levels) % levels) * 255 + 5) / (levels - 1));
+            colors[i * 3 + 2] = static_cast<uchar>(((i % levels) * 255 + 7) / (levels - 1));
+        }
+        std::vector<uchar> expected(colors.size());
+        std::vector<uchar> mapped(colors.size());
+        cmsDoTransform(reference, colors.data(), expected.data(), static_cast<cmsUInt32Number>(samples));
+        map(colors.data(), mapped.data(), samples);
+        std::vector<cmsCIELab> expectedLab(samples);
+        std::vector<cmsCIELab> mappedLab(samples);
+        cmsDoTransform(measure, expected.data(), expectedLab.data(), static_cast<cmsUInt32Number>(samples));
+        cmsDoTransform(measure, mapped.data(), mappedLab.data(), static_cast<cmsUInt32Number>(samples));
+        for (int i = 0; i < samples; ++i) {
+            deltaE = qMax<double>(deltaE, cmsCIE2000DeltaE(&expectedLab[i], &mappedLab[i], 1.0, 1.0, 1.0));
+        }
     }
-    if (!cache[profile].contains(format)) {
-        cache[profile].insert(format, QMap<QString, cmsHTRANSFORM>());
+    if (reference) {
+        cmsDeleteTransform(reference);
     }
-    if (!cache[profile][format].contains(outProfile)) {
-        cmsHPROFILE cmsProfile = cmsOpenProfileFromFile(profile.toLocal8Bit().constData(), "r");
-        cmsHPROFILE cmsDisplayProfile = cmsOpenProfileFromFile(outProfile.toLocal8Bit().constData(), "r");
-        int flags = (format == QImage::Format_ARGB32_Premultiplied ? cmsFLAGS_COPY_ALPHA : 0);
-        cache[profile][format].insert(outProfile, cmsCreateTransform(cmsProfile, mapFormat(format), cmsDisplayProfile,
-                                                                     mapFormat(format), INTENT_PERCEPTUAL, flags));
-        cmsCloseProfile(cmsProfile);
-        cmsCloseProfile(cmsDisplayProfile);
+    if (measure) {
+        cmsDeleteTransform(measure);
     }
-    return cache[profile][format][outProfile];
+    if (lab) {
+        cmsCloseProfile(lab);
+    }
+    return deltaE;
 }
 
-cmsHTRANSFORM
-ICCTransformPrivate::mapTransform(const QColorSpace& colorSpace, const QString& outProfile, QImage::Format format)
+int
+ICCTransformPrivate::mapBands(int width, int height)
 {
-    QString profile = colorSpace.description();
-    QByteArray data = colorSpace.iccProfile();
-    if (!cache.contains(profile)) {
-        cache.insert(profile, QMap<QImage::Format, QMap<QString, cmsHTRANSFORM>>());
+    if (!parallel.loadRelaxed()) {
+        return 1;
+    }
+    // bands of at least 64k pixels keep scheduling overhead small, two bands
+    // per thread balances the load when threads are busy elsewhere
+    const qint64 minimum = 65536;
+    qint64 pixels = static_cast<qint64>(width) * height;
+    qint64 bands = qMin<qint64>(pixels / minimum, pool.maxThreadCount() * 2);
+    return static_cast<int>(qBound<qint64>(1, bands, height));
+}
+
+void
+ICCTransformPrivate::mapLines(const Transform* transform, const uchar* input, uchar* output, int width, int height,
+                              qsizetype inputStride, qsizetype outputStride, const std::function<bool()>& canceled)
+{
+    if (!transform->transform) {
+        // identity between equivalent profiles
+        if (input != output) {
+            qsizetype bytes = width * (QImage::toPixelFormat(transform->format).bitsPerPixel() / 8);
+            for (int line = 0; line < height; ++line) {
+                std::memcpy(output + line * outputStride, input + line * inputStride, bytes);
+            }
+        }
+        return;
     }
-    if (!cache[profile].contains(format)) {
-        cache[profile].insert(format, QMap<QString, cmsHTRANSFORM>());
+    auto lines = [=](int y, int count) {
+        if (transform->matrix) {
+            for (int line = y; line < y + count; ++line) {
+                matrixMap(*transform->matrix, transform->format, input + line * inputStride,
+                          output + line * outputStride, width);
+            }
+        }
+        else if (transform->lut) {
+            for (int line = y; line < y + count; ++line) {
+                lutMap(*transform->lut, transform->format, input + line * inputStride, output + line * outputStride,
+                       width);
+            }
+        }
+        else {
+            cmsDoTransformLineStride(transform->transform, input + y * inputStride, output + y * outputStride, width,
+                                     count, static_cast<cmsUInt32Number>(inputStride),
+                                     static_cast<cmsUInt32Number>(outputStride), 0, 0);
+        }
+    };
+    int bands = mapBands(width, height);
+    if (bands <= 1) {
+        if (!canceled || !canceled()) {
+            lines(0, height);
+        }
+        return;
     }
-    if (!cache[profile][format].contains(outProfile)) {
-        cmsHPROFILE cmsProfile = cmsOpenProfileFromMem(data.constData(), static_cast<cmsUInt32Number>(data.size()));
-        cmsHPROFILE cmsDisplayProfile = cmsOpenProfileFromFile(outProfile.toLocal8Bit().constData(), "r");
-        int flags = (format == QImage::Format_ARGB32_Premultiplied ? cmsFLAGS_COPY_ALPHA : 0);
-        cache[profile][format].insert(outProfile, cmsCreateTransform(cmsProfile, mapFormat(format), cmsDisplayProfile,
-                                                                     mapFormat(format), INTENT_PERCEPTUAL, flags));
-        cmsCloseProfile(cmsProfile);
-        cmsCloseProfile(cmsDisplayProfile);
+    class Bands {
+    public:
+        QAtomicInt next;
+        QSemaphore done;
+    };
+    QSharedPointer<Bands> shared(new Bands());
+    int rows = (height + bands - 1) / bands;
+    auto work = [=]() {
+        int band;
+        while ((band = shared->next.fetchAndAddRelaxed(1)) < bands) {
+            if (canceled && canceled()) {
+                break;  // remaining bands are skipped, the result is discarded
+            }
+            int y = band * rows;
+            int count = qMin(rows, height - y);
+            if (count > 0) {
+                lines(y, count);
+            }
+        }
+    };
+    // workers only start on idle threads, the calling thread takes bands too
+    // so a saturated pool never blocks the transform
+    int started = 0;
+    int workers = qMin(bands, pool.maxThreadCount()) - 1;
+    for (int i = 0; i < workers; i++) {
+        if (!pool.tryStart([=]() {
+                work();
+                shared->done.release();
+            })) {
+            break;
+        }
+        started++;
     }
-    return cache[profile][format][outProfile];
+    work();
+    shared->done.acquire(started);
 }
 
 QImage
-ICCTransformPrivate::mapImage(QImage image, cmsHTRANSFORM transform)
+ICCTransformPrivate::mapImage(QImage image, const Transform* transform)
 {
-    QImage mapped(image.width(), image.height(), image.format());
-    cmsDoTransformLineStride(transform, image.constBits(), mapped.bits(), image.width(), image.height(),
-                             static_cast<cmsUInt32Number>(image.bytesPerLine()),
-                             static_cast<cmsUInt32Number>(mapped.bytesPerLine()), 0, 0);
-    mapped.setDevicePixelRatio(image.devicePixelRatio());
+    if (!transform) {
+        return image;
+    }
+    QImage mapped;
+    mapImage(image, mapped, transform);
     return mapped;
 }
 
+void
+ICCTransformPrivate::mapImage(const QImage& image, QImage& destination, const Transform* transform)
+{
+    mapImage(image, image.rect(), destination, transform);
+}
+
+void
+ICCTransformPrivate::mapImage(const QImage& image, const QRect& rect, QImage& destination, const Transform* transform,
+                              const std::function<bool()>& canceled)
+{
+    if (canceled && canceled()) {
+        return;  // the result is discarded
+    }
+    if (!transform->transform) {
+        destination = rect == image.rect() ? image : image.copy(rect);  // identity, shared
+        return;
+    }
+    // wall time of the whole call, bands mapped in parallel are not summed
+    QElapsedTimer timer;
+    timer.start();
+    auto counted = qScopeGuard([&] {
+        transform->counters->pixels.fetchAndAddRelaxed(static_cast<quint64>(rect.width()) * rect.height());
+        transform->counters->mapTime.fetchAndAddRelaxed(timer.nsecsElapsed());
+    });
+    if (image.format() != transform->format) {
+        // mapped in the working format and converted back
+        QImage working = (rect == image.rect() ? image : image.copy(rect)).convertToFormat(transform->format);
+        mapLines(transform, working.constBits(), working.bits(), working.width(), working.height(),
+                 working.bytesPerLine(), working.bytesPerLine(), canceled);
+        destination = working.convertToFormat(image.format());
+        destination.setDevicePixelRatio(image.devicePixelRatio());
+        return;
+    }
+    // reuse the destination buffer when it matches, the same image maps in place
+    if (destination.size() != rect.size() || destination.format() != image.format()) {
+        destination = QImage(rect.width(), rect.height(), image.format());
+    }
+    uchar* bits = destination.bits();
+    // rect lines are read in place from the source, no copy
+    const uchar* input = image.constScanLine(rect.top()) + rect.left() * (image.depth() / 8);
+    mapLines(transform, input, bits, rect.width(), rect.height(), image.bytesPerLine(), destination.bytesPerLine(),
+             canceled);
+    destination.setDevicePixelRatio(image.devicePixelRatio());
+}
+
 QRgb
 ICCTransformPrivate::map(QRgb color, const QString& profile, const QString& outProfile)
 {
-    cmsHTRANSFORM transform = mapTransform(profile, outProfile, QImage::Format_RGB32);
-    QRgb transformColor;
-    cmsDoTransform(transform, &color, &transformColor, 1);
-    return transformColor;
+    QRgb mapped;
+    map(&color, &mapped, 1, profile, outProfile);
+    return mapped;
+}
+
+bool
+ICCTransformPrivate::map(const QRgb* colors, QRgb* mapped, qsizetype count, const QString& profile,
+                         const QString& outProfile)
+{
+    return mapColors(mapTransform(profile, outProfile, QImage::Format_RGB32).data(), colors, mapped, count);
+}
+
+QRgb
+ICCTransformPrivate::map(QRgb color, const QColorSpace& colorSpace, const QString& outProfile)
+{
+    QRgb mapped;
+    mapColors(mapTransform(colorSpace, outProfile, QImage::Format_RGB32).data(), &color, &mapped, 1);
+    return mapped;
+}
+
+bool
+ICCTransformPrivate::mapColors(Transform* transform, const QRgb* colors, QRgb* mapped, qsizetype count)
+{
+    if (!transform) {
+        if (colors != mapped) {
+            std::copy(colors, colors + count, mapped);
+        }
+        return false;
+    }
+    if (!transform->transform) {
+        if (colors != mapped) {
+            std::copy(colors, colors + count, mapped);  // identity
+        }
+        return true;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    auto counted = qScopeGuard([&] {
+        transform->counters->pixels.fetchAndAddRelaxed(static_cast<quint64>(count));
+        transform->counters->mapTime.fetchAndAddRelaxed(timer.nsecsElapsed());
+    });
+    // colors are served from the memo where possible, misses are
+    // transformed in one call and memoized, alpha is kept as is
+    const Memo* memo = transform->memo.data();
+    QVarLengthArray<qsizetype, 64> indices;
+    QVarLengthArray<QRgb, 64> misses;
+    for (qsizetype i = 0; i < count; ++i) {
+        if (!memo->find(colors[i], &mapped[i])) {
+            indices.append(i);
+            misses.append(colors[i]);
+        }
+    }
+    colorHits.fetchAndAddRelaxed(static_cast<quint64>(count - misses.count()));
+    if (misses.isEmpty()) {
+        return true;
+    }
+    colorMisses.fetchAndAddRelaxed(static_cast<quint64>(misses.count()));
+    cmsDoTransform(transform->transform, misses.constData(), misses.data(),
+                   static_cast<cmsUInt32Number>(misses.count()));
+    for (qsizetype i = 0; i < indices.count(); ++i) {
+        QRgb color = colors[indices[i]];
+        transform->memo->insert(color, misses[i]);
+        mapped[indices[i]] = (color & 0xff000000) | (misses[i] & 0xffffff);
+    }
+    return true;
+}
+
+QList<QRgb>
+ICCTransformPrivate::map(const QList<QRgb>& colors, const QStringList& profiles, const QString& outProfile)
+{
+    Q_ASSERT(colors.count() == profiles.count());
+    QList<QRgb> mapped = colors;
+    // group indices by profile, one transform lookup and call per group
+    QHash<QString, QList<qsizetype>> groups;
+    for (qsizetype i = 0; i < colors.count(); ++i) {
+        if (profiles[i] != outProfile) {
+            groups[profiles[i]].append(i);
+        }
+    }
+    QList<QRgb> batch;
+    for (auto it = groups.cbegin(); it != groups.cend(); ++it) {
+        const QList<qsizetype>& indices = it.value();
+        batch.resize(indices.count());
+        for (qsizetype i = 0; i < indices.count(); ++i) {
+            batch[i] = colors[indices[i]];
+        }
+        map(batch.constData(), batch.data(), batch.count(), it.key(), outProfile);
+        for (qsizetype i = 0; i < indices.count(); ++i) {
+            mapped[indices[i]] = batch[i];
+        }
+    }
+    return mapped;
 }
 
 QImage
 ICCTransformPrivate::map(QImage image, const QString& profile, const QString& outProfile)
 {
-    cmsHTRANSFORM transform = mapTransform(profile, outProfile, image.format());
-    return mapImage(image, transform);
+    QSharedPointer<Transform> transform = mapTransform(profile, outProfile, mapWorkingFormat(image.format()));
+    if (!transform) {
+        return image;
+    }
+    return mapImage(image, transform.data());
 }
 
 QImage
 ICCTransformPrivate::map(QImage image, const QColorSpace& colorSpace, const QString& outProfile)
 {
-    cmsHTRANSFORM transform = mapTransform(colorSpace, outProfile, image.format());
-    return mapImage(image, transform);
+    QSharedPointer<Transform> transform = mapTransform(colorSpace, outProfile, mapWorkingFormat(image.format()));
+    if (!transform) {
+        return image;
+    }
+    return mapImage(image, transform.data());
+}
+
+bool
+ICCTransformPrivate::map(const QImage& image, QImage& destination, const QString& profile, const QString& outProfile)
+{
+    QSharedPointer<Transform> transform = mapTransform(profile, outProfile, mapWorkingFormat(image.format()));
+    if (!transform) {
+        return false;
+    }
+    mapImage(image, destination, transform.data());
+    return true;
+}
+
+bool
+ICCTransformPrivate::map(const QImage& image, QImage& destination, const QStringList& profiles)
+{
+    QSharedPointer<Transform> transform = mapTransform(profiles, mapWorkingFormat(image.format()));
+    if (!transform) {
+        return false;
+    }
+    mapImage(image, destination, transform.data());
+    return true;
+}
+
+bool
+ICCTransformPrivate::map(const QImage& image, const QRect& rect, QImage& destination, const QStringList& profiles)
+{
+    QRect region = rect.intersected(image.rect());
+    if (region.isEmpty()) {
+        return false;
+    }
+    QSharedPointer<Transform> transform = mapTransform(profiles, mapWorkingFormat(image.format()));
+    if (!transform) {
+        return false;
+    }
+    mapImage(image, region, destination, transform.data());
+    return true;
 }
 
 #include "icctransform.moc"
@@ -155,22 +1995,164 @@ ICCTransform::ICCTransform()
     : p(new ICCTransformPrivate())
 {}
 
-ICCTransform::~ICCTransform() { p->cache.clear(); }
+ICCTransform::~ICCTransform() {}
+
+bool
+ICCTransform::isMappable(QImage::Format format) const
+{
+    return p->mapFormat(p->mapWorkingFormat(format)) != 0;
+}
+
+int
+ICCTransform::cacheLimit() const
+{
+    QMutexLocker locker(&p->cacheMutex);
+    return static_cast<int>(p->cache.maxCost());
+}
+
+void
+ICCTransform::setCacheLimit(int limit)
+{
+    QMutexLocker locker(&p->cacheMutex);
+    qsizetype count = p->cache.count();
+    p->cache.setMaxCost(qMax(1, limit));
+    qsizetype evicted = count - p->cache.count();
+    if (evicted > 0) {
+        p->evictions.fetchAndAddRelaxed(evicted);
+        p->invalidate();
+    }
+}
+
+bool
+ICCTransform::isParallel() const
+{
+    return p->parallel.loadRelaxed();
+}
+
+void
+ICCTransform::setParallel(bool parallel)
+{
+    p->parallel.storeRelaxed(parallel);
+}
+
+int
+ICCTransform::lutSize() const
+{
+    return p->lutSize.loadRelaxed();
+}
+
+void
+ICCTransform::setLutSize(int size)
+{
+    size = size > 0 ? qBound(2, size, 65) : 0;
+    if (p->lutSize.fetchAndStoreRelaxed(size) != size) {
+        // cached transforms are rebuilt with or without a baked lut
+        QMutexLocker locker(&p->cacheMutex);
+        p->cache.clear();
+        p->invalidate();
+    }
+}
+
+double
+ICCTransform::lutDeltaE(const QString& inputProfile, const QString& outputProfile)
+{
+    QSharedPointer<ICCTransformPrivate::Transform> transform = p->mapTransform(inputProfile, outputProfile,
+                                                                               QImage::Format_RGB32);
+    if (!transform || !transform->lut) {
+        return -1.0;
+    }
+    return transform->lut->deltaE;
+}
+
+double
+ICCTransform::matrixDeltaE(const QString& inputProfile, const QString& outputProfile)
+{
+    // the color format never uses the matrix, images do
+    QSharedPointer<ICCTransformPrivate::Transform> transform = p->mapTransform(inputProfile, outputProfile,
+                                                                               QImage::Format_ARGB32);
+    if (!transform || !transform->matrix) {
+        return -1.0;
+    }
+    return transform->matrix->deltaE;
+}
+
+QList<float>
+ICCTransform::linearTable(const QString& profile, int depth)
+{
+    return p->linearTable(profile, depth);
+}
+
+QString
+ICCTransform::profileId(const QString& profile)
+{
+    QSharedPointer<ICCTransformPrivate::Profile> parsed = p->openProfile(profile);
+    return parsed ? parsed->id : QString();
+}
+
+QString
+ICCTransform::profileId(const QColorSpace& colorSpace)
+{
+    QByteArray data = colorSpace.iccProfile();
+    return data.isEmpty() ? QString() : p->profileId(data);
+}
+
+QString
+ICCTransform::linkCacheDirectory() const
+{
+    QReadLocker locker(&p->linkDirectoryLock);
+    return p->linkDirectory;
+}
+
+void
+ICCTransform::setLinkCacheDirectory(const QString& directory)
+{
+    QWriteLocker locker(&p->linkDirectoryLock);
+    p->linkDirectory = directory;
+}
+
+void
+ICCTransform::prewarm(const QList<Prewarm>& transforms)
+{
+    p->prewarm(transforms);
+}
+
+QList<ICCTransform::PairStatistics>
+ICCTransform::pairStatistics() const
+{
+    QList<PairStatistics> statistics;
+    QMutexLocker locker(&p->countersMutex);
+    for (const QSharedPointer<ICCTransformPrivate::Counters>& counters : p->counters) {
+        statistics.append(PairStatistics { counters->profile, counters->via, counters->outProfile,
+                                           counters->builds.loadRelaxed(), counters->buildTime.loadRelaxed(),
+                                           counters->hits.loadRelaxed(), counters->pixels.loadRelaxed(),
+                                           counters->mapTime.loadRelaxed() });
+    }
+    return statistics;
+}
+
+ICCTransform::CacheStatistics
+ICCTransform::cacheStatistics() const
+{
+    QMutexLocker locker(&p->cacheMutex);
+    return CacheStatistics { static_cast<int>(p->cache.count()), p->hits.loadRelaxed(), p->misses.loadRelaxed(),
+                             p->evictions.loadRelaxed(), p->colorHits.loadRelaxed(), p->colorMisses.loadRelaxed() };
+}
 
 ICCTransform*
 ICCTransform::instance()
 {
-    static QMutex mutex;
-    QMutexLocker locker(&mutex);
-    if (!pi) {
+    // thread-safe static initialization, no lock once constructed
+    static ICCTransform* instance = [] {
         pi.reset(new ICCTransform());
-    }
-    return pi.data();
+        return pi.data();
+    }();
+    return instance;
 }
 
 QString
 ICCTransform::ICCTransform::inputProfile() const
 {
+    QReadLocker locker(&p->profileLock);
     Q_ASSERT(!p->inputProfile.isEmpty());
     return p->inputProfile;
 }
@@ -178,13 +2160,18 @@ ICCTransform::ICCTransform::inputProfile() const
 void
 ICCTransform::ICCTransform::setInputProfile(const QString& inputProfile)
 {
-    p->inputProfile = inputProfile;
+    {
+        QWriteLocker locker(&p->profileLock);
+        p->inputProfile = inputProfile;
+    }
+    p->reloadProfile(inputProfile);
     inputProfileChanged(inputProfile);
 }
 
 QString
 ICCTransform::ICCTransform::outputProfile() const
 {
+    QReadLocker locker(&p->profileLock);
     Q_ASSERT(!p->outputProfile.isEmpty());
     return p->outputProfile;
 }
@@ -192,20 +2179,24 @@ ICCTransform::ICCTransform::outputProfile() const
 void
 ICCTransform::ICCTransform::setOutputProfile(const QString& outputProfile)
 {
-    p->outputProfile = outputProfile;
+    {
+        QWriteLocker locker(&p->profileLock);
+        p->outputProfile = outputProfile;
+    }
+    p->reloadProfile(outputProfile);  // e.g. rewritten by a display recalibration
     outputProfileChanged(outputProfile);
 }
 
 QRgb
 ICCTransform::ICCTransform::map(QRgb color)
 {
-    return p->map(color, p->inputProfile, p->outputProfile);
+    return p->map(color, inputProfile(), outputProfile());
 }
 
 QImage
 ICCTransform::ICCTransform::map(const QImage& image)
 {
-    return p->map(image, p->inputProfile, p->outputProfile);
+    return p->map(image, inputProfile(), outputProfile());
 }
 
 QRgb
@@ -214,16 +2205,69 @@ ICCTransform::ICCTransform::map(QRgb color, const QString& inputProfile, const Q
     return p->map(color, inputProfile, outputProfile);
 }
 
+bool
+ICCTransform::map(const QRgb* colors, QRgb* mapped, qsizetype count, const QString& inputProfile,
+                  const QString& outputProfile)
+{
+    return p->map(colors, mapped, count, inputProfile, outputProfile);
+}
+
+QList<QRgb>
+ICCTransform::map(const QList<QRgb>& colors, const QString& inputProfile, const QString& outputProfile)
+{
+    QList<QRgb> mapped(colors.count());
+    p->map(colors.constData(), mapped.data(), colors.count(), inputProfile, outputProfile);
+    return mapped;
+}
+
+QList<QRgb>
+ICCTransform::map(const QList<QRgb>& colors, const QStringList& profiles, const QString& outputProfile)
+{
+    return p->map(colors, profiles, outputProfile);
+}
+
 QImage
 ICCTransform::map(const QImage& image, const QString& inputProfile, const QString& outputProfile)
 {
     return p->map(image, inputProfile, outputProfile);
 }
 
+bool
+ICCTransform::mapInPlace(QImage& image, const QString& inputProfile, const QString& outputProfile)
+{
+    return p->map(image, image, inputProfile, outputProfile);
+}
+
+bool
+ICCTransform::mapInto(const QImage& image, QImage& destination, const QString& inputProfile,
+                      const QString& outputProfile)
+{
+    return p->map(image, destination, inputProfile, outputProfile);
+}
+
+QImage
+ICCTransform::map(const QImage& image, const QStringList& profiles)
+{
+    QImage mapped;
+    return p->map(image, mapped, profiles) ? mapped : image;
+}
+
+bool
+ICCTransform::mapInto(const QImage& image, QImage& destination, const QStringList& profiles)
+{
+    return p->map(image, destination, profiles);
+}
+
+bool
+ICCTransform::mapInto(const QImage& image, const QRect& rect, QImage& destination, const QStringList& profiles)
+{
+    return p->map(image, rect, destination, profiles);
+}
+
 QRgb
 ICCTransform::map(QRgb color, const QColorSpace& colorSpace, const QString& outputProfile)
 {
-    return QRgb();
+    return p->map(color, colorSpace, outputProfile);
 }
 
 QImage
@@ -231,3 +2275,28 @@ ICCTransform::map(const QImage& image, const QColorSpace& colorSpace, const QStr
 {
     return p->map(image, colorSpace, outputProfile);
 }
+
+QFuture<QImage>
+ICCTransform::mapAsync(const QImage& image, const QString& inputProfile, const QString& outputProfile)
+{
+    QImage::Format format = p->mapWorkingFormat(image.format());
+    return p->mapAsync(image, [this, inputProfile, outputProfile, format] {
+        return p->mapTransform(inputProfile, outputProfile, format);
+    });
+}
+
+QFuture<QImage>
+ICCTransform::mapAsync(const QImage& image, const QColorSpace& colorSpace, const QString& outputProfile)
+{
+    QImage::Format format = p->mapWorkingFormat(image.format());
+    return p->mapAsync(image, [this, colorSpace, outputProfile, format] {
+        return p->mapTransform(colorSpace, outputProfile, format);
+    });
+}
+
+QFuture<QImage>
+ICCTransform::mapAsync(const QImage& image, const QStringList& profiles)
+{
+    QImage::Format format = p->mapWorkingFormat(image.format());
+    return p->mapAsync(image, [this, profiles, format] { return p->mapTransform(profiles, format); });
+}
@@ -9,6 +9,7 @@
 # This module defines the following variables:
 #
 #   LCMS2_FOUND         True if Lcms2 was found
+#   LCMS2_VERSION       Version of Lcms2, read from lcms2.h
 #   LCMS2_INCLUDE_DIRS  Where to find Lcms2 header files
 #   LCMS2_LIBRARIES     List of Lcms2 libraries to link against
 
@@ -29,10 +30,18 @@ find_library (LCMS2_LIBRARY NAMES lcms2 lcms2.2
                     /usr
 )
 
-find_package_handle_standard_args (Lcms2 
-    DEFAULT_MSG
-    LCMS2_INCLUDE_DIR
-    LCMS2_LIBRARY
+if (LCMS2_INCLUDE_DIR AND EXISTS "${LCMS2_INCLUDE_DIR}/lcms2.h")
+    file (STRINGS "${LCMS2_INCLUDE_DIR}/lcms2.h" LCMS2_VERSION_DEFINE
+          REGEX "^#define[ \t]+LCMS_VERSION[ \t]+[0-9]+")
+    string (REGEX REPLACE ".*LCMS_VERSION[ \t]+([0-9]+).*" "\\1" LCMS2_VERSION_NUMBER "${LCMS2_VERSION_DEFINE}")
+    math (EXPR LCMS2_VERSION_MAJOR "${LCMS2_VERSION_NUMBER} / 1000")
+    math (EXPR LCMS2_VERSION_MINOR "(${LCMS2_VERSION_NUMBER} % 1000) / 10")
+    set (LCMS2_VERSION "${LCMS2_VERSION_MAJOR}.${LCMS2_VERSION_MINOR}")
+endif ()
+
+find_package_handle_standard_args (Lcms2
+    REQUIRED_VARS LCMS2_INCLUDE_DIR LCMS2_LIBRARY
+    VERSION_VAR LCMS2_VERSION
 )
 
 if (LCMS2_FOUND)
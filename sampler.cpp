@@ -0,0 +1,905 @@
+// Copyright 2022-present Contributors to the colorpicker project.
+// SPDX-License-Identifier: BSD-3-Clause
+// https://github.com/mikaelsundell/colorpicker
+
+#include "sampler.h"
+#include <QCache>
+#include <QList>
+#include <QScopedPointer>
+#include <QVarLengthArray>
+
+// stdc++
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+
+namespace {
+
+// 32-bit lane sums of one row are flushed into the 64-bit sums before they can
+// overflow, 16-bit channels of two pixels add up to 2 x 65535 per step
+const int flushPixels = 16384;
+
+// coverage of a physical pixel by the aperture in 1/256ths, a fully covered
+// pixel weighs coverageOne
+const int coverageOne = 256;
+
+// kernel weights are 15-bit so pixels and weights multiply as signed 16-bit,
+// 32-bit lane sums of weighted 8-bit channels are flushed every 256 pixels
+const int weightOne = 32767;
+const int weightFlushPixels = 256;
+
+// kernels are averaged over weightSamples x weightSamples points of each pixel,
+// cached tables are limited to weightsCost weights in total, a larger table
+// is held outside the cache until the next one replaces it
+const int weightSamples = 8;
+const int weightsCost = 1 << 20;
+
+// sums the four 8-bit lanes of a span of pixels
+void
+sum8Scalar(const uchar* line, int count, quint64* sums)
+{
+    quint32 lanes[4] = { 0, 0, 0, 0 };
+    for (int x = 0; x < count; ++x, line += 4) {
+        lanes[0] += line[0];
+        lanes[1] += line[1];
+        lanes[2] += line[2];
+        lanes[3] += line[3];
+    }
+    for (int c = 0; c < 4; ++c) {
+        sums[c] += lanes[c];
+    }
+}
+
+// sums the four 8-bit lanes of a span of pixels multiplied by their weights
+void
+sum8WeightedScalar(const uchar* line, const quint16* weights, int count, quint64* sums)
+{
+    for (int x = 0; x < count; ++x, line += 4) {
+        for (int c = 0; c < 4; ++c) {
+            sums[c] += static_cast<quint64>(weights[x]) * line[c];
+        }
+    }
+}
+
+void
+sum16Scalar(const uchar* line, int count, quint64* sums)
+{
+    const quint16* pixel = reinterpret_cast<const quint16*>(line);
+    for (int x = 0; x < count; ++x, pixel += 4) {
+        for (int c = 0; c < 4; ++c) {
+            sums[c] += pixel[c];
+        }
+    }
+}
+
+#if defined(__SSE2__)
+inline __m128i
+sum8Pixels(__m128i pixels)
+{
+    // four pixels widened to 16-bit and folded into one pixel of 32-bit lanes
+    const __m128i zero = _mm_setzero_si128();
+    __m128i pairs = _mm_add_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero));
+    return _mm_add_epi32(_mm_unpacklo_epi16(pairs, zero), _mm_unpackhi_epi16(pairs, zero));
+}
+
+void
+sum8SSE2(const uchar* line, int count, quint64* sums)
+{
+    __m128i lanes = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x * 4));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x * 4 + 16));
+        lanes = _mm_add_epi32(lanes, _mm_add_epi32(sum8Pixels(a), sum8Pixels(b)));
+    }
+    for (; x + 4 <= count; x += 4) {
+        lanes = _mm_add_epi32(lanes, sum8Pixels(_mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x * 4))));
+    }
+    quint32 values[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(values), lanes);
+    for (int c = 0; c < 4; ++c) {
+        sums[c] += values[c];
+    }
+    sum8Scalar(line + x * 4, count - x, sums);
+}
+
+void
+sum8WeightedSSE2(const uchar* line, const quint16* weights, int count, quint64* sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    while (x + 4 <= count) {
+        __m128i lanes = zero;
+        for (int end = qMin(count - 3, x + weightFlushPixels); x < end; x += 4) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x * 4));
+            __m128i low = _mm_unpacklo_epi8(pixels, zero);
+            __m128i high = _mm_unpackhi_epi8(pixels, zero);
+            // channels of pixels 0 and 2, 1 and 3 side by side, multiplied by their
+            // weights and added pairwise into 32-bit lanes
+            __m128i even = _mm_set1_epi32(weights[x] | weights[x + 2] << 16);
+            __m128i odd = _mm_set1_epi32(weights[x + 1] | weights[x + 3] << 16);
+            lanes = _mm_add_epi32(lanes, _mm_madd_epi16(_mm_unpacklo_epi16(low, high), even));
+            lanes = _mm_add_epi32(lanes, _mm_madd_epi16(_mm_unpackhi_epi16(low, high), odd));
+        }
+        quint32 values[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values), lanes);
+        for (int c = 0; c < 4; ++c) {
+            sums[c] += values[c];
+        }
+    }
+    sum8WeightedScalar(line + x * 4, weights + x, count - x, sums);
+}
+
+void
+sum16SSE2(const uchar* line, int count, quint64* sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    while (x + 2 <= count) {
+        __m128i lanes = zero;
+        for (int end = qMin(count - 1, x + flushPixels); x < end; x += 2) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x * 8));
+            lanes = _mm_add_epi32(lanes,
+                                  _mm_add_epi32(_mm_unpacklo_epi16(pixels, zero), _mm_unpackhi_epi16(pixels, zero)));
+        }
+        quint32 values[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values), lanes);
+        for (int c = 0; c < 4; ++c) {
+            sums[c] += values[c];
+        }
+    }
+    sum16Scalar(line + x * 8, count - x, sums);
+}
+#endif
+
+#if defined(__ARM_NEON)
+void
+sum8NEON(const uchar* line, int count, quint64* sums)
+{
+    uint32x4_t lanes = vdupq_n_u32(0);
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        uint8x16_t pixels = vld1q_u8(line + x * 4);
+        uint16x8_t pairs = vaddl_u8(vget_low_u8(pixels), vget_high_u8(pixels));
+        lanes = vaddq_u32(lanes, vaddl_u16(vget_low_u16(pairs), vget_high_u16(pairs)));
+    }
+    quint32 values[4];
+    vst1q_u32(values, lanes);
+    for (int c = 0; c < 4; ++c) {
+        sums[c] += values[c];
+    }
+    sum8Scalar(line + x * 4, count - x, sums);
+}
+
+void
+sum8WeightedNEON(const uchar* line, const quint16* weights, int count, quint64* sums)
+{
+    int x = 0;
+    while (x + 2 <= count) {
+        uint32x4_t lanes = vdupq_n_u32(0);
+        for (int end = qMin(count - 1, x + weightFlushPixels); x < end; x += 2) {
+            uint16x8_t pixels = vmovl_u8(vld1_u8(line + x * 4));
+            lanes = vmlal_n_u16(lanes, vget_low_u16(pixels), weights[x]);
+            lanes = vmlal_n_u16(lanes, vget_high_u16(pixels), weights[x + 1]);
+        }
+        quint32 values[4];
+        vst1q_u32(values, lanes);
+        for (int c = 0; c < 4; ++c) {
+            sums[c] += values[c];
+        }
+    }
+    sum8WeightedScalar(line + x * 4, weights + x, count - x, sums);
+}
+
+void
+sum16NEON(const uchar* line, int count, quint64* sums)
+{
+    int x = 0;
+    while (x + 2 <= count) {
+        uint32x4_t lanes = vdupq_n_u32(0);
+        for (int end = qMin(count - 1, x + flushPixels); x < end; x += 2) {
+            uint16x8_t pixels = vld1q_u16(reinterpret_cast<const quint16*>(line + x * 8));
+            lanes = vaddq_u32(lanes, vaddl_u16(vget_low_u16(pixels), vget_high_u16(pixels)));
+        }
+        quint32 values[4];
+        vst1q_u32(values, lanes);
+        for (int c = 0; c < 4; ++c) {
+            sums[c] += values[c];
+        }
+    }
+    sum16Scalar(line + x * 8, count - x, sums);
+}
+#endif
+
+void
+sum8(const uchar* line, int count, quint64* sums)
+{
+#if defined(__SSE2__)
+    sum8SSE2(line, count, sums);
+#elif defined(__ARM_NEON)
+    sum8NEON(line, count, sums);
+#else
+    sum8Scalar(line, count, sums);
+#endif
+}
+
+void
+sum8Weighted(const uchar* line, const quint16* weights, int count, quint64* sums)
+{
+#if defined(__SSE2__)
+    sum8WeightedSSE2(line, weights, count, sums);
+#elif defined(__ARM_NEON)
+    sum8WeightedNEON(line, weights, count, sums);
+#else
+    sum8WeightedScalar(line, weights, count, sums);
+#endif
+}
+
+void
+sum16(const uchar* line, int count, quint64* sums)
+{
+#if defined(__SSE2__)
+    sum16SSE2(line, count, sums);
+#elif defined(__ARM_NEON)
+    sum16NEON(line, count, sums);
+#else
+    sum16Scalar(line, count, sums);
+#endif
+}
+
+// adds a pixel of any summed layout scaled by a weight
+inline void
+sumPixel(const uchar* pixel, int bytes, quint64 weight, quint64* sums)
+{
+    if (bytes == 8) {
+        const quint16* channels = reinterpret_cast<const quint16*>(pixel);
+        for (int c = 0; c < 4; ++c) {
+            sums[c] += weight * channels[c];
+        }
+    }
+    else {
+        for (int c = 0; c < bytes; ++c) {
+            sums[c] += weight * pixel[c];
+        }
+    }
+}
+
+}  // namespace
+
+class SamplerPrivate {
+public:
+    SamplerPrivate()
+        : kernel(Sampler::Box)
+        , cache(weightsCost)
+    {}
+    /**
+     * @struct Layout
+     * @brief Describes where the channels of a pixel format are summed.
+     */
+    typedef struct {
+        int bytes;           ///< Bytes per pixel, 3, 4 or 8.
+        int channels[4];     ///< Sum lanes of red, green, blue and alpha, -1 for no alpha.
+        bool premultiplied;  ///< Channels are premultiplied by alpha.
+    } Layout;
+    /**
+     * @struct Coverage
+     * @brief Describes the physical pixels covered by an aperture along one axis.
+     */
+    typedef struct {
+        int first;     ///< First covered physical pixel.
+        int last;      ///< Last covered physical pixel.
+        quint64 head;  ///< Coverage of the first pixel.
+        quint64 tail;  ///< Coverage of the last pixel, unused if first is last.
+        int phase;     ///< Start of the unclipped aperture in its first pixel, in 1/256ths.
+        int span;      ///< Length of the unclipped aperture, in 1/256ths.
+        int offset;    ///< Pixels clipped off before the first pixel.
+    } Coverage;
+    /**
+     * @struct Region
+     * @brief Describes the pixels of an image covered by an aperture.
+     */
+    typedef struct {
+        QImage source;     ///< Image in a summed layout.
+        Layout layout;     ///< Layout of the source.
+        Coverage columns;  ///< Covered columns of the source.
+        Coverage rows;     ///< Covered rows of the source.
+    } Region;
+    class Key {
+    public:
+        Sampler::Kernel kernel;
+        int phasex;
+        int spanx;
+        int phasey;
+        int spany;
+        bool operator==(const Key& other) const
+        {
+            return kernel == other.kernel && phasex == other.phasex && spanx == other.spanx
+                   && phasey == other.phasey && spany == other.spany;
+        }
+    };
+    class Weights {
+    public:
+        int width;               // columns of the unclipped aperture
+        QList<quint16> values;   // kernel times coverage per pixel, row major, weightOne at most
+    };
+    bool layout(QImage::Format format, Layout* layout) const;
+    bool coverage(int from, int to, qreal dpr, int origin, int size, Coverage* coverage) const;
+    bool region(const QImage& image, const QRect& rect, Region* region) const;
+    quint64 weight(const Coverage& coverage, int pixel) const;
+    const Weights* weights(const Coverage& columns, const Coverage& rows) const;
+    const quint16* weightRow(const Weights* weights, const Region& region, int y) const;
+    bool pixel(const uchar* pixel, const Layout& layout, int maximum, int* values) const;
+    double encode(const float* table, int size, double value) const;
+    QColor color(const double* values, int maximum) const;
+    quint64 box(const Region& region, quint64* sums) const;
+    quint64 weighted(const Region& region, quint64* sums) const;
+    QColor linearAverage(const Region& region) const;
+    QColor average(const QImage& image, const QRect& rect) const;
+    Sampler::Statistics statistics(const QImage& image, const QRect& rect) const;
+    Sampler::Kernel kernel;
+    QList<float> linear;  // linear light of every code value per channel, empty averages code values
+    mutable QCache<Key, Weights> cache;
+    mutable QScopedPointer<Weights> oversized;
+    mutable Key oversizedkey;
+    mutable QList<quint64> histogram;
+};
+
+size_t
+qHash(const SamplerPrivate::Key& key, size_t seed = 0)
+{
+    return qHashMulti(seed, static_cast<int>(key.kernel), key.phasex, key.spanx, key.phasey, key.spany);
+}
+
+bool
+SamplerPrivate::layout(QImage::Format format, Layout* layout) const
+{
+    // byte order in memory, 32-bit argb formats are bgra on little endian
+    switch (format) {
+    case QImage::Format_RGB32: *layout = Layout { 4, { 2, 1, 0, -1 }, false }; return true;
+
+    case QImage::Format_ARGB32: *layout = Layout { 4, { 2, 1, 0, 3 }, false }; return true;
+
+    case QImage::Format_ARGB32_Premultiplied: *layout = Layout { 4, { 2, 1, 0, 3 }, true }; return true;
+
+    case QImage::Format_RGBX8888: *layout = Layout { 4, { 0, 1, 2, -1 }, false }; return true;
+
+    case QImage::Format_RGBA8888: *layout = Layout { 4, { 0, 1, 2, 3 }, false }; return true;
+
+    case QImage::Format_RGBA8888_Premultiplied: *layout = Layout { 4, { 0, 1, 2, 3 }, true }; return true;
+
+    case QImage::Format_RGB888: *layout = Layout { 3, { 0, 1, 2, -1 }, false }; return true;
+
+    case QImage::Format_BGR888: *layout = Layout { 3, { 2, 1, 0, -1 }, false }; return true;
+
+    case QImage::Format_RGBX64: *layout = Layout { 8, { 0, 1, 2, -1 }, false }; return true;
+
+    case QImage::Format_RGBA64: *layout = Layout { 8, { 0, 1, 2, 3 }, false }; return true;
+
+    case QImage::Format_RGBA64_Premultiplied: *layout = Layout { 8, { 0, 1, 2, 3 }, true }; return true;
+
+    default: return false;
+    }
+}
+
+bool
+SamplerPrivate::coverage(int from, int to, qreal dpr, int origin, int size, Coverage* coverage) const
+{
+    // logical edges in physical 1/256ths, snapped so integral scales cover whole pixels,
+    // relative to the physical pixel the image starts at
+    qint64 from256 = qRound64(from * dpr * coverageOne) - static_cast<qint64>(origin) * coverageOne;
+    qint64 to256 = qRound64(to * dpr * coverageOne) - static_cast<qint64>(origin) * coverageOne;
+    qint64 first = from256 >= 0 ? from256 / coverageOne : -((-from256 + coverageOne - 1) / coverageOne);
+    qint64 start = qMax<qint64>(0, from256);
+    qint64 end = qMin<qint64>(static_cast<qint64>(size) * coverageOne, to256);
+    if (end <= start) {
+        return false;
+    }
+    coverage->phase = static_cast<int>(from256 - first * coverageOne);
+    coverage->span = static_cast<int>(to256 - from256);
+    coverage->first = static_cast<int>(start / coverageOne);
+    coverage->offset = static_cast<int>(coverage->first - first);
+    coverage->last = static_cast<int>((end - 1) / coverageOne);
+    if (coverage->first == coverage->last) {
+        coverage->head = coverage->tail = end - start;
+    }
+    else {
+        coverage->head = (coverage->first + 1) * coverageOne - start;
+        coverage->tail = end - coverage->last * coverageOne;
+    }
+    return true;
+}
+
+bool
+SamplerPrivate::region(const QImage& image, const QRect& rect, Region* region) const
+{
+    qreal dpr = image.devicePixelRatio();
+    QPoint offset = image.offset();
+    if (!coverage(rect.left(), rect.right() + 1, dpr, offset.x(), image.width(), &region->columns)
+        || !coverage(rect.top(), rect.bottom() + 1, dpr, offset.y(), image.height(), &region->rows)) {
+        return false;
+    }
+    region->source = image;
+    if (!layout(image.format(), &region->layout)) {
+        // converted for the covered pixels only
+        Coverage& columns = region->columns;
+        Coverage& rows = region->rows;
+        QRect physical(QPoint(columns.first, rows.first), QPoint(columns.last, rows.last));
+        region->source = image.copy(physical).convertToFormat(QImage::Format_ARGB32);
+        columns.first -= physical.left();
+        columns.last -= physical.left();
+        rows.first -= physical.top();
+        rows.last -= physical.top();
+        layout(region->source.format(), &region->layout);
+    }
+    return true;
+}
+
+quint64
+SamplerPrivate::weight(const Coverage& coverage, int pixel) const
+{
+    if (pixel == coverage.first) {
+        return coverage.head;
+    }
+    return pixel == coverage.last ? coverage.tail : coverageOne;
+}
+
+const SamplerPrivate::Weights*
+SamplerPrivate::weights(const Coverage& columns, const Coverage& rows) const
+{
+    Key key { kernel, columns.phase, columns.span, rows.phase, rows.span };
+    if (Weights* weights = cache.object(key)) {
+        return weights;
+    }
+    if (oversized && oversizedkey == key) {
+        return oversized.data();
+    }
+    // kernels around the aperture center in 1/256ths, averaged over the covered
+    // part of each pixel and scaled by its coverage
+    Weights* weights = new Weights();
+    weights->width = (columns.phase + columns.span + coverageOne - 1) / coverageOne;
+    int height = (rows.phase + rows.span + coverageOne - 1) / coverageOne;
+    weights->values.resize(weights->width * height);
+    const double radius = qMin(columns.span, rows.span) / 2.0;
+    const double sigma = radius / 2.0;
+    for (int y = 0; y < height; ++y) {
+        double top = qMax(0, y * coverageOne - rows.phase);
+        double bottom = qMin(rows.span, (y + 1) * coverageOne - rows.phase);
+        for (int x = 0; x < weights->width; ++x) {
+            double left = qMax(0, x * coverageOne - columns.phase);
+            double right = qMin(columns.span, (x + 1) * coverageOne - columns.phase);
+            double kernel = 0.0;
+            for (int j = 0; j < weightSamples; ++j) {
+                double v = top + (j + 0.5) * (bottom - top) / weightSamples - rows.span / 2.0;
+                for (int i = 0; i < weightSamples; ++i) {
+                    double u = left + (i + 0.5) * (right - left) / weightSamples - columns.span / 2.0;
+                    double distance = u * u + v * v;
+                    if (key.kernel == Sampler::Circle) {
+                        kernel += distance <= radius * radius ? 1.0 : 0.0;
+                    }
+                    else {
+                        kernel += std::exp(-distance / (2.0 * sigma * sigma));
+                    }
+                }
+            }
+            double coverage = (right - left) * (bottom - top) / (coverageOne * coverageOne);
+            kernel /= weightSamples * weightSamples;
+            weights->values[y * weights->width + x] = static_cast<quint16>(qRound(kernel * coverage * weightOne));
+        }
+    }
+    // insert deletes tables costing more than the whole cache
+    if (weights->values.size() > cache.maxCost()) {
+        oversized.reset(weights);
+        oversizedkey = key;
+        return weights;
+    }
+    cache.insert(key, weights, weights->values.size());
+    return weights;
+}
+
+const quint16*
+SamplerPrivate::weightRow(const Weights* weights, const Region& region, int y) const
+{
+    // weights of the first covered column, clipped apertures skip their offsets
+    int row = y - region.rows.first + region.rows.offset;
+    return weights->values.constData() + row * weights->width + region.columns.offset;
+}
+
+inline bool
+SamplerPrivate::pixel(const uchar* pixel, const Layout& layout, int maximum, int* values) const
+{
+    // red, green, blue and alpha of a pixel, premultiplied pixels are unpremultiplied
+    // and transparent ones have no color
+    values[3] = maximum;
+    for (int c = 0; c < 4 && layout.channels[c] >= 0; ++c) {
+        int lane = layout.channels[c];
+        values[c] = layout.bytes == 8 ? reinterpret_cast<const quint16*>(pixel)[lane] : pixel[lane];
+    }
+    if (layout.premultiplied) {
+        int alpha = values[3];
+        if (!alpha) {
+            return false;
+        }
+        for (int c = 0; c < 3; ++c) {
+            qint64 value = (static_cast<qint64>(values[c]) * maximum + alpha / 2) / alpha;
+            values[c] = static_cast<int>(qMin<qint64>(maximum, value));
+        }
+    }
+    return true;
+}
+
+double
+SamplerPrivate::encode(const float* table, int size, double value) const
+{
+    // code value of linear light by bisection of the increasing table,
+    // interpolated between the codes around it
+    const float* upper = std::lower_bound(table, table + size, static_cast<float>(value));
+    if (upper == table) {
+        return 0.0;
+    }
+    if (upper == table + size) {
+        return size - 1;
+    }
+    const float* lower = upper - 1;
+    double step = *upper - *lower;
+    return (lower - table) + (step > 0.0 ? (value - *lower) / step : 0.0);
+}
+
+QColor
+SamplerPrivate::color(const double* values, int maximum) const
+{
+    int channels[3];
+    for (int c = 0; c < 3; ++c) {
+        channels[c] = qBound(0, qRound(values[c]), maximum);
+    }
+    if (maximum == 65535) {
+        return QColor::fromRgba64(channels[0], channels[1], channels[2]);
+    }
+    return QColor(channels[0], channels[1], channels[2]);
+}
+
+quint64
+SamplerPrivate::box(const Region& region, quint64* sums) const
+{
+    // every physical pixel under the aperture is summed, pixels on the edges of
+    // fractional scales are weighted by how much of them the aperture covers
+    const Layout& layout = region.layout;
+    const Coverage& columns = region.columns;
+    const Coverage& rows = region.rows;
+    // fully covered pixels between the edges are summed as a span
+    int span = qMax(0, columns.last - columns.first - 1);
+    for (int y = rows.first; y <= rows.last; ++y) {
+        const uchar* line = region.source.constScanLine(y);
+        quint64 row[4] = { 0, 0, 0, 0 };
+        const uchar* inner = line + (columns.first + 1) * layout.bytes;
+        if (layout.bytes == 4) {
+            sum8(inner, span, row);
+        }
+        else if (layout.bytes == 8) {
+            sum16(inner, span, row);
+        }
+        else {
+            for (int x = 0; x < span; ++x) {
+                sumPixel(inner + x * layout.bytes, layout.bytes, 1, row);
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            row[c] *= coverageOne;
+        }
+        sumPixel(line + columns.first * layout.bytes, layout.bytes, columns.head, row);
+        if (columns.last != columns.first) {
+            sumPixel(line + columns.last * layout.bytes, layout.bytes, columns.tail, row);
+        }
+        quint64 factor = weight(rows, y);
+        for (int c = 0; c < 4; ++c) {
+            sums[c] += row[c] * factor;
+        }
+    }
+    quint64 width = columns.head + (columns.last != columns.first ? columns.tail : 0) + span * coverageOne;
+    quint64 height = rows.head + (rows.last != rows.first ? rows.tail : 0)
+                     + qMax(0, rows.last - rows.first - 1) * coverageOne;
+    return width * height;
+}
+
+quint64
+SamplerPrivate::weighted(const Region& region, quint64* sums) const
+{
+    // pixels multiplied by the cached kernel weights, which include the coverage
+    const Layout& layout = region.layout;
+    const Coverage& columns = region.columns;
+    const Coverage& rows = region.rows;
+    const Weights* weights = this->weights(columns, rows);
+    int count = columns.last - columns.first + 1;
+    quint64 total = 0;
+    for (int y = rows.first; y <= rows.last; ++y) {
+        const uchar* line = region.source.constScanLine(y) + columns.first * layout.bytes;
+        const quint16* row = weightRow(weights, region, y);
+        if (layout.bytes == 4) {
+            sum8Weighted(line, row, count, sums);
+        }
+        else {
+            for (int x = 0; x < count; ++x) {
+                sumPixel(line + x * layout.bytes, layout.bytes, row[x], sums);
+            }
+        }
+        for (int x = 0; x < count; ++x) {
+            total += row[x];
+        }
+    }
+    return total;
+}
+
+QColor
+SamplerPrivate::linearAverage(const Region& region) const
+{
+    // code values decoded through the tables per pixel, accumulated as linear
+    // light in float per row and the mean re-encoded
+    const Layout& layout = region.layout;
+    const Coverage& columns = region.columns;
+    const int maximum = layout.bytes == 8 ? 65535 : 255;
+    const int size = maximum + 1;
+    const float* tables[3] = { linear.constData(), linear.constData() + size, linear.constData() + size * 2 };
+    const Weights* weights = kernel != Sampler::Box ? this->weights(columns, region.rows) : nullptr;
+    const int count = columns.last - columns.first + 1;
+    // box rows share the column coverages and are scaled by the row coverage
+    QVarLengthArray<float, 512> coverages(count);
+    for (int x = 0; x < count; ++x) {
+        coverages[x] = static_cast<int>(weight(columns, columns.first + x));
+    }
+    double sums[3] = { 0.0, 0.0, 0.0 };
+    double total = 0.0;
+    for (int y = region.rows.first; y <= region.rows.last; ++y) {
+        const uchar* line = region.source.constScanLine(y) + columns.first * layout.bytes;
+        float scale = 1.0f;
+        if (weights) {
+            const quint16* row = weightRow(weights, region, y);
+            for (int x = 0; x < count; ++x) {
+                coverages[x] = row[x];
+            }
+        }
+        else {
+            scale = static_cast<int>(weight(region.rows, y));
+        }
+        float rowsums[3] = { 0.0f, 0.0f, 0.0f };
+        float rowtotal = 0.0f;
+        if (layout.bytes != 8 && !layout.premultiplied) {
+            const int red = layout.channels[0], green = layout.channels[1], blue = layout.channels[2];
+            for (int x = 0; x < count; ++x, line += layout.bytes) {
+                float coverage = coverages[x];
+                rowsums[0] += coverage * tables[0][line[red]];
+                rowsums[1] += coverage * tables[1][line[green]];
+                rowsums[2] += coverage * tables[2][line[blue]];
+                rowtotal += coverage;
+            }
+        }
+        else {
+            for (int x = 0; x < count; ++x, line += layout.bytes) {
+                int values[4];
+                if (!pixel(line, layout, maximum, values)) {
+                    continue;
+                }
+                // premultiplied pixels are weighted by alpha like the code value mean
+                float coverage = coverages[x];
+                if (layout.premultiplied) {
+                    coverage *= static_cast<float>(values[3]) / maximum;
+                }
+                for (int c = 0; c < 3; ++c) {
+                    rowsums[c] += coverage * tables[c][values[c]];
+                }
+                rowtotal += coverage;
+            }
+        }
+        for (int c = 0; c < 3; ++c) {
+            sums[c] += static_cast<double>(rowsums[c]) * scale;
+        }
+        total += static_cast<double>(rowtotal) * scale;
+    }
+    if (total <= 0.0) {
+        return QColor();
+    }
+    double values[3];
+    for (int c = 0; c < 3; ++c) {
+        values[c] = encode(tables[c], size, sums[c] / total);
+    }
+    return color(values, maximum);
+}
+
+QColor
+SamplerPrivate::average(const QImage& image, const QRect& rect) const
+{
+    Region region;
+    if (!this->region(image, rect, &region)) {
+        return QColor();
+    }
+    const Layout& layout = region.layout;
+    if (linear.size() == (layout.bytes == 8 ? 65536 : 256) * 3) {
+        return linearAverage(region);
+    }
+    quint64 sums[4] = { 0, 0, 0, 0 };
+    quint64 total = kernel == Sampler::Box ? box(region, sums) : weighted(region, sums);
+    if (!total) {
+        return QColor();
+    }
+    // rounded means, premultiplied channels are divided by the summed alpha
+    const quint64 maximum = layout.bytes == 8 ? 65535 : 255;
+    double values[3];
+    for (int c = 0; c < 3; ++c) {
+        quint64 sum = sums[layout.channels[c]];
+        if (layout.premultiplied) {
+            quint64 alpha = sums[layout.channels[3]];
+            values[c] = alpha ? static_cast<double>(sum) * maximum / alpha : 0.0;
+        }
+        else {
+            values[c] = static_cast<double>((sum + total / 2) / total);
+        }
+    }
+    return color(values, static_cast<int>(maximum));
+}
+
+Sampler::Statistics
+SamplerPrivate::statistics(const QImage& image, const QRect& rect) const
+{
+    Region region;
+    if (!this->region(image, rect, &region)) {
+        return Sampler::Statistics();
+    }
+    const Layout& layout = region.layout;
+    // one coverage weighted histogram per channel, 16-bit channels are binned to 12 bits
+    const int maximum = layout.bytes == 8 ? 65535 : 255;
+    const int shift = layout.bytes == 8 ? 4 : 0;
+    const int bins = (maximum >> shift) + 1;
+    histogram.fill(0, bins * 3);
+    quint64 total = 0;
+    double sums[3] = { 0.0, 0.0, 0.0 };
+    double squares[3] = { 0.0, 0.0, 0.0 };
+    double minimums[3] = { double(maximum), double(maximum), double(maximum) };
+    double maximums[3] = { 0.0, 0.0, 0.0 };
+    const Weights* weights = kernel != Sampler::Box ? this->weights(region.columns, region.rows) : nullptr;
+    for (int y = region.rows.first; y <= region.rows.last; ++y) {
+        const uchar* line = region.source.constScanLine(y);
+        quint64 height = weight(region.rows, y);
+        const quint16* row = weights ? weightRow(weights, region, y) : nullptr;
+        for (int x = region.columns.first; x <= region.columns.last; ++x) {
+            int values[4];
+            if (!pixel(line + x * layout.bytes, layout, maximum, values)) {
+                continue;
+            }
+            quint64 coverage = row ? row[x - region.columns.first] : weight(region.columns, x) * height;
+            if (!coverage) {
+                continue;
+            }
+            total += coverage;
+            for (int c = 0; c < 3; ++c) {
+                double value = values[c];
+                histogram[c * bins + (values[c] >> shift)] += coverage;
+                sums[c] += coverage * value;
+                squares[c] += coverage * value * value;
+                minimums[c] = qMin(minimums[c], value);
+                maximums[c] = qMax(maximums[c], value);
+            }
+        }
+    }
+    if (!total) {
+        return Sampler::Statistics();
+    }
+    // percentiles and the 5% trimmed mean walk the cumulative weights, bins are
+    // represented by their center
+    double medians[3], lows[3], highs[3], trimmed[3], deviations[3];
+    const double lowcut = total * 0.05;
+    const double highcut = total * 0.95;
+    for (int c = 0; c < 3; ++c) {
+        const quint64* channel = histogram.constData() + c * bins;
+        double cumulative = 0.0;
+        double trimmedsum = 0.0;
+        double trimmedweight = 0.0;
+        bool low = false, median = false, high = false;
+        for (int bin = 0; bin < bins; ++bin) {
+            if (!channel[bin]) {
+                continue;
+            }
+            double value = qMin(maximum, (bin << shift) | ((1 << shift) >> 1));
+            double next = cumulative + channel[bin];
+            if (!low && next >= lowcut) {
+                lows[c] = value;
+                low = true;
+            }
+            if (!median && next >= total * 0.5) {
+                medians[c] = value;
+                median = true;
+            }
+            if (!high && next >= highcut) {
+                highs[c] = value;
+                high = true;
+            }
+            double inside = qMin(next, highcut) - qMax(cumulative, lowcut);
+            if (inside > 0.0) {
+                trimmedsum += inside * value;
+                trimmedweight += inside;
+            }
+            cumulative = next;
+        }
+        trimmed[c] = trimmedweight > 0.0 ? trimmedsum / trimmedweight : medians[c];
+        double mean = sums[c] / total;
+        deviations[c] = std::sqrt(qMax(0.0, squares[c] / total - mean * mean)) / maximum;
+    }
+    Sampler::Statistics statistics;
+    statistics.median = color(medians, maximum);
+    statistics.low = color(lows, maximum);
+    statistics.high = color(highs, maximum);
+    statistics.minimum = color(minimums, maximum);
+    statistics.maximum = color(maximums, maximum);
+    statistics.trimmed = color(trimmed, maximum);
+    statistics.deviation = QColor::fromRgbF(deviations[0], deviations[1], deviations[2]);
+    return statistics;
+}
+
+Sampler::Sampler()
+    : p(new SamplerPrivate())
+{}
+
+Sampler::~Sampler() {}
+
+int
+Sampler::depth(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied: return 16;
+    default: return 8;
+    }
+}
+
+void
+Sampler::setLinearTable(const QList<float>& table)
+{
+    p->linear = table;
+}
+
+void
+Sampler::setKernel(Kernel kernel)
+{
+    p->kernel = kernel;
+}
+
+Sampler::Kernel
+Sampler::kernel() const
+{
+    return p->kernel;
+}
+
+QRect
+Sampler::aperture(const QSize& grab, int aperture)
+{
+    return QRect((grab.width() - aperture) / 2, (grab.height() - aperture) / 2, aperture, aperture);
+}
+
+QRect
+Sampler::pixels(const QRect& rect, qreal dpr)
+{
+    // edges rounded like the coverage of average and statistics
+    auto first = [dpr](int from) {
+        return static_cast<int>(std::floor(qRound64(from * dpr * coverageOne) / double(coverageOne)));
+    };
+    auto last = [dpr](int to) {
+        return static_cast<int>(std::ceil(qRound64(to * dpr * coverageOne) / double(coverageOne))) - 1;
+    };
+    return QRect(QPoint(first(rect.left()), first(rect.top())),
+                 QPoint(last(rect.right() + 1), last(rect.bottom() + 1)));
+}
+
+QColor
+Sampler::average(const QImage& image, const QRect& rect) const
+{
+    return p->average(image, rect);
+}
+
+Sampler::Statistics
+Sampler::statistics(const QImage& image, const QRect& rect) const
+{
+    return p->statistics(image, rect);
+}
@@ -0,0 +1,120 @@
+// Copyright 2022-present Contributors to the colorpicker project.
+// SPDX-License-Identifier: BSD-3-Clause
+// https://github.com/mikaelsundell/colorpicker
+
+#pragma once
+
+#include <QColor>
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QScopedPointer>
+
+class SamplerPrivate;
+
+/**
+ * @class Sampler
+ * @brief Reduces an aperture of an image to a color.
+ *
+ * Reads the aperture straight from the image scanlines, row by row, with
+ * vectorized sums for 8-bit and 16-bit four channel formats and 64-bit
+ * accumulators. Other formats are converted for the aperture only.
+ *
+ * Every physical pixel under the aperture is averaged, at fractional device
+ * pixel ratios the pixels on its edges are weighted by their coverage.
+ */
+class Sampler {
+public:
+    /**
+     * @brief Kernels the aperture is weighted by.
+     */
+    enum Kernel { Box, Circle, Gaussian };
+
+    /**
+     * @struct Statistics
+     * @brief Per channel statistics of an aperture, invalid colors if it is empty.
+     */
+    typedef struct {
+        QColor median;     ///< Median per channel.
+        QColor low;        ///< 5th percentile per channel.
+        QColor high;       ///< 95th percentile per channel.
+        QColor minimum;    ///< Minimum per channel.
+        QColor maximum;    ///< Maximum per channel.
+        QColor trimmed;    ///< Mean of the 5th to 95th percentiles per channel.
+        QColor deviation;  ///< Standard deviation per channel.
+    } Statistics;
+
+    /**
+     * @brief Constructs a Sampler.
+     */
+    Sampler();
+
+    /**
+     * @brief Destroys the Sampler.
+     */
+    virtual ~Sampler();
+
+    /**
+     * @brief Sets the kernel the aperture is weighted by, defaults to Box.
+     *
+     * Circle weighs the inscribed circle, Gaussian falls off with a sigma of a
+     * quarter of the aperture. Weight tables are cached per aperture, device
+     * pixel ratio and kernel.
+     */
+    void setKernel(Kernel kernel);
+
+    /**
+     * @brief Returns the kernel the aperture is weighted by.
+     */
+    Kernel kernel() const;
+
+    /**
+     * @brief Sets tables decoding code values to linear light, see ICCTransform::linearTable.
+     *
+     * While set, images of the table depth are averaged in linear light, one table
+     * lookup per pixel, and the mean is encoded back through the tables. An empty
+     * table averages code values. Statistics always use code values.
+     */
+    void setLinearTable(const QList<float>& table);
+
+    /**
+     * @brief Returns the channel depth a format is sampled at, 8 or 16.
+     */
+    static int depth(QImage::Format format);
+
+    /**
+     * @brief Returns an aperture of the given size centered in a grab, in logical pixels.
+     */
+    static QRect aperture(const QSize& grab, int aperture);
+
+    /**
+     * @brief Returns the physical pixels a rectangle in logical pixels covers, unclipped.
+     */
+    static QRect pixels(const QRect& rect, qreal dpr);
+
+    /**
+     * @brief Returns the average color of a rectangle of an image, in logical pixels.
+     *
+     * Premultiplied pixels are averaged weighted by alpha, the result is opaque.
+     * Returns an invalid color if the rectangle is outside the image. An image offset,
+     * in physical pixels, places an image holding only part of a larger one, such as
+     * the pixels(), so the rectangle keeps referring to the larger one.
+     */
+    QColor average(const QImage& image, const QRect& rect) const;
+
+    /**
+     * @brief Returns per channel statistics of a rectangle of an image, in logical pixels.
+     *
+     * Computed from one kernel and coverage weighted histogram pass, 16-bit channels are
+     * binned to 12 bits for the percentiles. Premultiplied pixels are
+     * unpremultiplied and transparent pixels are skipped. Images are placed by their
+     * offset as in average().
+     */
+    Statistics statistics(const QImage& image, const QRect& rect) const;
+
+private:
+    Sampler(const Sampler&) = delete;
+    Sampler& operator=(const Sampler&) = delete;
+
+    QScopedPointer<SamplerPrivate> p;
+};
@@ -0,0 +1,449 @@
+// Copyright 2022-present Contributors to the colorpicker project.
+// SPDX-License-Identifier: BSD-3-Clause
+// https://github.com/mikaelsundell/colorpicker
+
+#include "icctransform.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QList>
+#include <QPair>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+struct Format
+{
+    QImage::Format format;
+    const char* name;
+};
+
+struct Accuracy
+{
+    double max;
+    double mean;
+};
+
+QList<Format>
+formats()
+{
+    return {
+        { QImage::Format_ARGB32, "ARGB32" },
+        { QImage::Format_ARGB32_Premultiplied, "ARGB32_Premultiplied" },
+        { QImage::Format_RGB32, "RGB32" },
+        { QImage::Format_RGB888, "RGB888" },
+        { QImage::Format_BGR888, "BGR888" },
+        { QImage::Format_RGBX8888, "RGBX8888" },
+        { QImage::Format_RGBA8888, "RGBA8888" },
+        { QImage::Format_RGBA8888_Premultiplied, "RGBA8888_Premultiplied" },
+        { QImage::Format_Grayscale8, "Grayscale8" },
+        { QImage::Format_Grayscale16, "Grayscale16" },
+        { QImage::Format_RGBX64, "RGBX64" },
+        { QImage::Format_RGBA64, "RGBA64" },
+        { QImage::Format_RGBA64_Premultiplied, "RGBA64_Premultiplied" },
+        { QImage::Format_RGB30, "RGB30" },
+        { QImage::Format_BGR30, "BGR30" },
+        { QImage::Format_A2RGB30_Premultiplied, "A2RGB30_Premultiplied" },
+        { QImage::Format_A2BGR30_Premultiplied, "A2BGR30_Premultiplied" },
+        { QImage::Format_RGBX16FPx4, "RGBX16FPx4" },
+        { QImage::Format_RGBA16FPx4, "RGBA16FPx4" },
+        { QImage::Format_RGBA16FPx4_Premultiplied, "RGBA16FPx4_Premultiplied" },
+        { QImage::Format_RGBX32FPx4, "RGBX32FPx4" },
+        { QImage::Format_RGBA32FPx4, "RGBA32FPx4" },
+        { QImage::Format_RGBA32FPx4_Premultiplied, "RGBA32FPx4_Premultiplied" }
+    };
+}
+
+QImage
+gradient(int width, int height, QImage::Format format)
+{
+    QImage image(width, height, QImage::Format_ARGB32);
+    for (int y = 0; y < height; ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            line[x] = qRgba((x * 255) / width, (y * 255) / height, ((x + y) * 7) & 0xff, 0xff - (x & 0x3f));
+        }
+    }
+    return image.convertToFormat(format);
+}
+
+int
+iterations(qint64 pixels)
+{
+    // about 50 Mpix per measurement, at least 3 runs for a stable median
+    return static_cast<int>(qBound<qint64>(3, 50000000 / qMax<qint64>(1, pixels), 25));
+}
+
+double
+measure(ICCTransform* transform, const QImage& image, const QString& input, const QString& output, int iterations)
+{
+    QList<double> timings;
+    for (int i = 0; i < iterations; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        QImage mapped = transform->map(image, input, output);
+        timings.append(timer.nsecsElapsed() / 1e6);
+    }
+    std::sort(timings.begin(), timings.end());
+    return timings.at(timings.size() / 2);  // median in milliseconds
+}
+
+QImage
+grid()
+{
+    // 32^3 grid colors at 16-bit
+    const int levels = 32;
+    const int samples = levels * levels * levels;
+    QImage image(256, samples / 256, QImage::Format_RGBA64);
+    for (int i = 0; i < samples; ++i) {
+        int r = ((i / (levels * levels)) * 255) / (levels - 1);
+        int g = (((i / levels) % levels) * 255) / (levels - 1);
+        int b = ((i % levels) * 255) / (levels - 1);
+        quint16* pixel = reinterpret_cast<quint16*>(image.scanLine(i / 256)) + (i % 256) * 4;
+        pixel[0] = static_cast<quint16>(r * 257);
+        pixel[1] = static_cast<quint16>(g * 257);
+        pixel[2] = static_cast<quint16>(b * 257);
+        pixel[3] = 0xffff;
+    }
+    return image;
+}
+
+std::vector<double>
+values(const QImage& image)
+{
+    // rgb values over the unit range, pixel by pixel
+    QImage converted = image.convertToFormat(QImage::Format_RGBA64);
+    std::vector<double> values(static_cast<size_t>(converted.width()) * converted.height() * 3);
+    for (int y = 0, i = 0; y < converted.height(); ++y) {
+        const quint16* pixel = reinterpret_cast<const quint16*>(converted.constScanLine(y));
+        for (int x = 0; x < converted.width(); ++x, pixel += 4) {
+            for (int c = 0; c < 3; ++c, ++i) {
+                values[i] = pixel[c] / 65535.0;
+            }
+        }
+    }
+    return values;
+}
+
+Accuracy
+compare(const QString& output, const std::vector<double>& expected, const std::vector<double>& values)
+{
+    // deltaE 2000 between two sets of output profile values, measured in lab
+    Accuracy result { -1.0, -1.0 };
+    int samples = static_cast<int>(expected.size() / 3);
+    cmsHPROFILE out = cmsOpenProfileFromFile(qPrintable(output), "r");
+    cmsHPROFILE lab = cmsCreateLab4Profile(nullptr);
+    cmsHTRANSFORM measure = out ? cmsCreateTransform(out, TYPE_RGB_DBL, lab, TYPE_Lab_DBL, INTENT_RELATIVE_COLORIMETRIC,
+                                                     cmsFLAGS_NOOPTIMIZE)
+                                : nullptr;
+    if (measure && samples && values.size() == expected.size()) {
+        std::vector<cmsCIELab> expectedLab(samples);
+        std::vector<cmsCIELab> mappedLab(samples);
+        cmsDoTransform(measure, expected.data(), expectedLab.data(), samples);
+        cmsDoTransform(measure, values.data(), mappedLab.data(), samples);
+        double sum = 0.0;
+        result.max = 0.0;
+        for (int i = 0; i < samples; ++i) {
+            double deltaE = cmsCIE2000DeltaE(&expectedLab[i], &mappedLab[i], 1.0, 1.0, 1.0);
+            result.max = qMax(result.max, deltaE);
+            sum += deltaE;
+        }
+        result.mean = sum / samples;
+    }
+    if (measure) {
+        cmsDeleteTransform(measure);
+    }
+    for (cmsHPROFILE handle : { out, lab }) {
+        if (handle) {
+            cmsCloseProfile(handle);
+        }
+    }
+    return result;
+}
+
+Accuracy
+accuracy(ICCTransform* transform, const QString& input, const QString& output, QImage::Format format)
+{
+    // grid colors mapped by ICCTransform and by an unoptimized double precision lcms
+    // transform, both measured in lab through the output profile
+    QImage image = grid();
+    std::vector<double> colors = values(image);
+    QImage mapped = transform->map(image.convertToFormat(format), input, output);
+    Accuracy result { -1.0, -1.0 };
+    cmsHPROFILE in = cmsOpenProfileFromFile(qPrintable(input), "r");
+    cmsHPROFILE out = cmsOpenProfileFromFile(qPrintable(output), "r");
+    cmsHTRANSFORM reference = (in && out) ? cmsCreateTransform(in, TYPE_RGB_DBL, out, TYPE_RGB_DBL, INTENT_PERCEPTUAL,
+                                                               cmsFLAGS_NOOPTIMIZE)
+                                          : nullptr;
+    if (reference) {
+        std::vector<double> expected(colors.size());
+        cmsDoTransform(reference, colors.data(), expected.data(), static_cast<cmsUInt32Number>(colors.size() / 3));
+        for (double& value : expected) {
+            value = qBound(0.0, value, 1.0);  // out of gamut clips in integer formats
+        }
+        result = compare(output, expected, values(mapped));
+        cmsDeleteTransform(reference);
+    }
+    for (cmsHPROFILE handle : { in, out }) {
+        if (handle) {
+            cmsCloseProfile(handle);
+        }
+    }
+    return result;
+}
+
+int
+sampleClut(const cmsUInt16Number input[], cmsUInt16Number output[], void* cargo)
+{
+    // clut nodes evaluated through the transform passed as cargo
+    cmsDoTransform(static_cast<cmsHTRANSFORM>(cargo), input, output, 1);
+    return TRUE;
+}
+
+QString
+lutProfile(const QString& directory)
+{
+    // a lut based copy of srgb, device-links are only built for chains that are
+    // not all matrix-shaper
+    QString path = QDir(directory).filePath("sRGB Lut.icc");
+    cmsHPROFILE srgb = cmsCreate_sRGBProfile();
+    cmsHPROFILE lab = cmsCreateLab4Profile(nullptr);
+    cmsHTRANSFORM toLab = cmsCreateTransform(srgb, TYPE_RGB_16, lab, TYPE_Lab_16, INTENT_PERCEPTUAL,
+                                             cmsFLAGS_NOOPTIMIZE);
+    cmsHTRANSFORM fromLab = cmsCreateTransform(lab, TYPE_Lab_16, srgb, TYPE_RGB_16, INTENT_PERCEPTUAL,
+                                               cmsFLAGS_NOOPTIMIZE);
+    cmsHPROFILE profile = cmsCreateProfilePlaceholder(nullptr);
+    cmsSetProfileVersion(profile, 4.3);
+    cmsSetDeviceClass(profile, cmsSigDisplayClass);
+    cmsSetColorSpace(profile, cmsSigRgbData);
+    cmsSetPCS(profile, cmsSigLabData);
+    cmsWriteTag(profile, cmsSigMediaWhitePointTag, cmsD50_XYZ());
+    const QList<QPair<cmsTagSignature, cmsHTRANSFORM>> tables = { { cmsSigAToB0Tag, toLab },
+                                                                  { cmsSigBToA0Tag, fromLab } };
+    bool saved = toLab && fromLab;
+    for (const QPair<cmsTagSignature, cmsHTRANSFORM>& table : tables) {
+        cmsPipeline* pipeline = cmsPipelineAlloc(nullptr, 3, 3);
+        cmsStage* clut = cmsStageAllocCLut16bit(nullptr, 33, 3, 3, nullptr);
+        saved = saved && cmsStageSampleCLut16bit(clut, sampleClut, table.second, 0)
+                && cmsPipelineInsertStage(pipeline, cmsAT_END, clut) && cmsWriteTag(profile, table.first, pipeline);
+        cmsPipelineFree(pipeline);
+    }
+    saved = saved && cmsSaveProfileToFile(profile, qPrintable(path));
+    for (cmsHTRANSFORM handle : { toLab, fromLab }) {
+        if (handle) {
+            cmsDeleteTransform(handle);
+        }
+    }
+    for (cmsHPROFILE handle : { srgb, lab, profile }) {
+        cmsCloseProfile(handle);
+    }
+    return saved ? path : QString();
+}
+
+Accuracy
+linkAccuracy(ICCTransform* transform, const QString& input, const QString& output, const QString& matrixInput,
+             const QString& directory)
+{
+    // the first build maps from the profiles and writes the link in the background,
+    // a second format builds a new transform that reads the link back, matrix-shaper
+    // pairs write none
+    Accuracy result { -1.0, -1.0 };
+    transform->setLinkCacheDirectory(directory);
+    transform->map(gradient(1, 1, QImage::Format_ARGB32), matrixInput, output);
+    QImage image = grid();
+    QImage direct = transform->map(image.convertToFormat(QImage::Format_ARGB32), input, output);
+    QStringList links;
+    QElapsedTimer timer;
+    timer.start();
+    while (links.isEmpty() && timer.elapsed() < 10000) {
+        QThread::msleep(10);
+        links = QDir(directory).entryList({ "*.icc" }, QDir::Files);
+    }
+    QImage linked = transform->map(image.convertToFormat(QImage::Format_RGBA8888), input, output);
+    transform->setLinkCacheDirectory(QString());
+    if (links.size() == 1) {
+        result = compare(output, values(direct), values(linked));
+    }
+    return result;
+}
+
+void
+statistics(ICCTransform* transform, const char* label, const ICCTransform::CacheStatistics& since)
+{
+    ICCTransform::CacheStatistics current = transform->cacheStatistics();
+    std::printf("%-22s %8d %10llu %10llu %10llu %12llu %12llu\n", label, current.count,
+                static_cast<unsigned long long>(current.hits - since.hits),
+                static_cast<unsigned long long>(current.misses - since.misses),
+                static_cast<unsigned long long>(current.evictions - since.evictions),
+                static_cast<unsigned long long>(current.colorHits - since.colorHits),
+                static_cast<unsigned long long>(current.colorMisses - since.colorMisses));
+}
+
+int
+main(int argc, const char* argv[])
+{
+    QDir iccprofiles(argc > 1 ? QString::fromLocal8Bit(argv[1]) : QString(ICCPROFILES_DIR));
+    QStringList profiles;
+    for (const QFileInfo& info : iccprofiles.entryInfoList({ "*.icc" }, QDir::Files, QDir::Name)) {
+        profiles.append(info.absoluteFilePath());
+    }
+    QString input = iccprofiles.filePath("sRGB Profile.icc");
+    QString output = iccprofiles.filePath("Display P3.icc");
+    if (!QFileInfo::exists(input) || !QFileInfo::exists(output)) {
+        std::fprintf(stderr, "Missing ICC profiles in: %s\n", qPrintable(iccprofiles.absolutePath()));
+        return EXIT_FAILURE;
+    }
+    QList<QPair<QString, QString>> pairs;
+    for (const QString& from : profiles) {
+        for (const QString& to : profiles) {
+            if (from != to) {
+                pairs.append({ from, to });
+            }
+        }
+    }
+
+    ICCTransform* transform = ICCTransform::instance();
+    transform->setCacheLimit(static_cast<int>(pairs.size()) * 4);
+    ICCTransform::CacheStatistics start = transform->cacheStatistics();
+
+    // first map builds the transform, profiles are parsed on first use
+    std::printf("Profile pairs, ARGB32 and RGBA64, deltaE 2000 against double precision lcms, %d threads\n",
+                QThread::idealThreadCount());
+    std::printf("%-22s %-22s %-8s %9s %9s %9s %9s %9s %9s %9s\n", "input", "output", "path", "create ms",
+                "lookup us", "Mpix/s", "max dE", "mean dE", "max dE16", "mean dE16");
+    QImage frame = gradient(1920, 1080, QImage::Format_ARGB32);
+    QImage pixel = gradient(1, 1, QImage::Format_ARGB32);
+    for (const QPair<QString, QString>& pair : pairs) {
+        QElapsedTimer timer;
+        timer.start();
+        QImage mapped = transform->map(pixel, pair.first, pair.second);
+        double create = timer.nsecsElapsed() / 1e6;
+        transform->map(gradient(1, 1, QImage::Format_RGBA64), pair.first, pair.second);
+        const int lookups = 1000;
+        timer.restart();
+        for (int i = 0; i < lookups; ++i) {
+            transform->map(pixel, pair.first, pair.second);
+        }
+        double lookup = timer.nsecsElapsed() / 1e3 / lookups;
+        const char* path = "lcms";
+        if (mapped.constBits() == pixel.constBits()) {
+            path = "identity";  // equivalent profiles, the image is shared
+        }
+        else if (transform->matrixDeltaE(pair.first, pair.second) >= 0) {
+            path = "matrix";
+        }
+        double ms = measure(transform, frame, pair.first, pair.second, iterations(1920 * 1080));
+        Accuracy argb = accuracy(transform, pair.first, pair.second, QImage::Format_ARGB32);
+        Accuracy rgba64 = accuracy(transform, pair.first, pair.second, QImage::Format_RGBA64);
+        std::printf("%-22s %-22s %-8s %9.2f %9.2f %9.1f %9.3f %9.3f %9.3f %9.3f\n",
+                    qPrintable(QFileInfo(pair.first).completeBaseName().left(22)),
+                    qPrintable(QFileInfo(pair.second).completeBaseName().left(22)), path, create, lookup,
+                    (1920.0 * 1080.0 / 1e6) / (ms / 1e3), argb.max, argb.mean, rgba64.max, rgba64.mean);
+    }
+
+    const QList<QPair<int, int>> sizes = { { 64, 64 },     { 256, 256 },   { 1024, 1024 },
+                                           { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+    std::printf("\nBanded transform, %s -> %s\n", qPrintable(QFileInfo(input).completeBaseName()),
+                qPrintable(QFileInfo(output).completeBaseName()));
+    std::printf("%-26s %-11s %12s %12s %12s %9s\n", "format", "size", "serial ms", "parallel ms", "Mpix/s", "speedup");
+    for (const Format& format : formats()) {
+        for (const QPair<int, int>& size : sizes) {
+            QImage image = gradient(size.first, size.second, format.format);
+            // build the transform up front, images are returned unchanged
+            // for formats lcms cannot map between these profiles
+            if (transform->map(image, input, output) == image) {
+                std::printf("%-26s %-11s %12s\n", format.name, "-", "no transform");
+                break;
+            }
+            qint64 pixels = static_cast<qint64>(size.first) * size.second;
+            transform->setParallel(false);
+            double serial = measure(transform, image, input, output, iterations(pixels));
+            transform->setParallel(true);
+            double parallel = measure(transform, image, input, output, iterations(pixels));
+            QString dimensions = QString("%1x%2").arg(size.first).arg(size.second);
+            std::printf("%-26s %-11s %12.3f %12.3f %12.1f %8.2fx\n", format.name, qPrintable(dimensions), serial,
+                        parallel, (pixels / 1e6) / (parallel / 1e3), serial / parallel);
+        }
+    }
+
+    // unique colors miss the memo and go through lcms in one call, repeats are memo hits
+    std::printf("\nColors, %s -> %s\n", qPrintable(QFileInfo(input).completeBaseName()),
+                qPrintable(QFileInfo(output).completeBaseName()));
+    std::printf("%-22s %12s %12s\n", "call", "ms", "Mcolors/s");
+    std::mt19937 random(1);
+    QList<QRgb> colors(1 << 20);
+    for (QRgb& color : colors) {
+        color = random() | 0xff000000;
+    }
+    QList<QRgb> mapped(colors.size());
+    for (int pass = 0; pass < 2; ++pass) {
+        QElapsedTimer timer;
+        timer.start();
+        transform->map(colors.constData(), mapped.data(), colors.size(), input, output);
+        double ms = timer.nsecsElapsed() / 1e6;
+        std::printf("%-22s %12.2f %12.1f\n", pass ? "batch, repeated" : "batch, unique", ms,
+                    (colors.size() / 1e6) / (ms / 1e3));
+    }
+    const int singles = 100000;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < singles; ++i) {
+        transform->map(colors.at(i & 0xff), input, output);
+    }
+    double ms = timer.nsecsElapsed() / 1e6;
+    std::printf("%-22s %12.2f %12.1f\n", "single, repeated", ms, (singles / 1e6) / (ms / 1e3));
+
+    // a cache smaller than the working set evicts on every pass
+    std::printf("\nTransform cache\n");
+    std::printf("%-22s %8s %10s %10s %10s %12s %12s\n", "phase", "count", "hits", "misses", "evictions",
+                "color hits", "color misses");
+    statistics(transform, "all of the above", start);
+    for (int limit : { static_cast<int>(pairs.size()) * 4, 8 }) {
+        transform->setCacheLimit(limit);
+        ICCTransform::CacheStatistics since = transform->cacheStatistics();
+        for (int pass = 0; pass < 2; ++pass) {
+            for (const QPair<QString, QString>& pair : pairs) {
+                transform->map(pixel, pair.first, pair.second);
+            }
+        }
+        statistics(transform, qPrintable(QString("2 passes, limit %1").arg(limit)), since);
+    }
+    transform->setCacheLimit(64);
+
+    // lut size 0 is the lcms or matrix path
+    const QList<int> lutSizes = { 0, 17, 33, 65 };
+    QImage image = gradient(3840, 2160, QImage::Format_ARGB32);
+    std::printf("\nBaked 3D LUT, ARGB32 3840x2160, serial\n");
+    std::printf("%-22s %12s %12s %12s\n", "path", "ms", "Mpix/s", "max dE00");
+    transform->setParallel(false);
+    for (int lutSize : lutSizes) {
+        transform->setLutSize(lutSize);
+        transform->map(image, input, output);  // bake up front
+        double ms = measure(transform, image, input, output, iterations(3840 * 2160));
+        QString path = lutSize ? QString("lut %1").arg(lutSize) : QString("default");
+        std::printf("%-22s %12.2f %12.1f %12.3f\n", qPrintable(path), ms, (3840.0 * 2160.0 / 1e6) / (ms / 1e3),
+                    lutSize ? transform->lutDeltaE(input, output) : qMax(0.0, transform->matrixDeltaE(input, output)));
+    }
+    transform->setLutSize(0);
+    transform->setParallel(true);
+
+    // device-links are resampled pipelines and should match mapping from the profiles
+    const double linkTolerance = 1.0;
+    QTemporaryDir temporary;
+    QString lut = lutProfile(temporary.path());
+    std::printf("\nDevice-link cache, sRGB Lut -> %s, deltaE 2000 linked against direct\n",
+                qPrintable(QFileInfo(output).completeBaseName()));
+    std::printf("%-22s %12s %12s %12s\n", "path", "max dE00", "mean dE00", "result");
+    Accuracy link = lut.length() ? linkAccuracy(transform, lut, output, input, temporary.filePath("links"))
+                                 : Accuracy { -1.0, -1.0 };
+    bool passed = link.max >= 0 && link.max <= linkTolerance;
+    std::printf("%-22s %12.3f %12.3f %12s\n", "link", link.max, link.mean, passed ? "ok" : "failed");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}